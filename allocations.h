@@ -0,0 +1,73 @@
+#pragma once
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+// Heap allocation counter for checking that the render loop runs without
+// allocating. Building with -DGRAVITY_COUNT_ALLOCATIONS replaces the global
+// operator new and delete with versions that count, per thread, every
+// allocation made through them; without the flag nothing is replaced and
+// countingAllocations() is false. malloc calls made inside C libraries
+// (GLU, the GL driver) are not seen.
+//
+// The replacement operators are definitions, so include this header from
+// exactly one translation unit.
+
+#ifdef GRAVITY_COUNT_ALLOCATIONS
+
+static thread_local uint64_t threadAllocations = 0;
+
+static inline bool countingAllocations() { return true; }
+static inline uint64_t allocationCount() { return threadAllocations; }
+
+static inline void* countedAllocate(size_t bytes, size_t alignment) {
+    ++threadAllocations;
+    if (bytes == 0) bytes = 1;
+    void* p = nullptr;
+#ifdef _WIN32
+    p = _aligned_malloc(bytes, alignment);
+#else
+    if (posix_memalign(&p, alignment < sizeof(void*) ? sizeof(void*) : alignment, bytes) != 0) p = nullptr;
+#endif
+    return p;
+}
+
+static inline void countedFree(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+void* operator new(size_t bytes) {
+    void* p = countedAllocate(bytes, alignof(std::max_align_t));
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t bytes) { return operator new(bytes); }
+void* operator new(size_t bytes, std::align_val_t alignment) {
+    void* p = countedAllocate(bytes, (size_t)alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t bytes, std::align_val_t alignment) { return operator new(bytes, alignment); }
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept { return countedAllocate(bytes, alignof(std::max_align_t)); }
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept { return countedAllocate(bytes, alignof(std::max_align_t)); }
+
+void operator delete(void* p) noexcept { countedFree(p); }
+void operator delete[](void* p) noexcept { countedFree(p); }
+void operator delete(void* p, size_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t) noexcept { countedFree(p); }
+void operator delete(void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { countedFree(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { countedFree(p); }
+
+#else
+
+static inline bool countingAllocations() { return false; }
+static inline uint64_t allocationCount() { return 0; }
+
+#endif
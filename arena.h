@@ -0,0 +1,90 @@
+#pragma once
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+
+// Bump allocator for scratch that lives for one frame. allocate() carves
+// cache-line aligned blocks out of one buffer and reset() at the start of
+// the next frame hands all of it back at once; nothing is freed one by one
+// and no destructors run, so only trivially destructible types go in.
+//
+// A frame that needs more than the buffer holds takes the extra from the
+// heap. The next reset() then grows the buffer to that frame's high-water
+// mark, so allocations only happen while the scratch size is still being
+// discovered and never in steady state.
+
+class FrameArena {
+public:
+    static const size_t kAlignment = 64;
+
+    explicit FrameArena(size_t capacity = 0) { grow(capacity); }
+    ~FrameArena() {
+        releaseOverflow();
+        ::operator delete(buffer, std::align_val_t(kAlignment));
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    size_t capacity() const { return size; }
+    size_t used() const { return offset; }
+    size_t highWater() const { return peak; }
+
+    // uninitialized storage for count objects of T, valid until reset()
+    template <typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destroyed");
+        static_assert(alignof(T) <= kAlignment, "over-aligned type");
+        size_t bytes = roundUp(count * sizeof(T));
+        peak = std::max(peak, offset + bytes);
+        if (offset + bytes <= size) {
+            T* block = reinterpret_cast<T*>(buffer + offset);
+            offset += bytes;
+            return block;
+        }
+        offset += bytes;
+        Overflow* extra = static_cast<Overflow*>(::operator new(sizeof(Overflow) + bytes, std::align_val_t(kAlignment)));
+        extra->next = overflow;
+        overflow = extra;
+        return reinterpret_cast<T*>(reinterpret_cast<unsigned char*>(extra) + sizeof(Overflow));
+    }
+
+    void reset() {
+        if (overflow) {
+            releaseOverflow();
+            grow(peak);
+        }
+        offset = 0;
+    }
+
+private:
+    // header of a heap block used after the buffer ran out; keeps the
+    // payload behind it on the arena alignment
+    struct alignas(kAlignment) Overflow {
+        Overflow* next;
+    };
+
+    unsigned char* buffer = nullptr;
+    size_t size = 0, offset = 0, peak = 0;
+    Overflow* overflow = nullptr;
+
+    static size_t roundUp(size_t bytes) { return (bytes + kAlignment - 1) & ~(kAlignment - 1); }
+
+    void grow(size_t capacity) {
+        capacity = roundUp(capacity);
+        if (capacity <= size) return;
+        ::operator delete(buffer, std::align_val_t(kAlignment));
+        buffer = static_cast<unsigned char*>(::operator new(capacity, std::align_val_t(kAlignment)));
+        size = capacity;
+    }
+
+    void releaseOverflow() {
+        while (overflow) {
+            Overflow* next = overflow->next;
+            ::operator delete(overflow, std::align_val_t(kAlignment));
+            overflow = next;
+        }
+    }
+};
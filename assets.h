@@ -5,6 +5,25 @@
 #include <random>
 #include <iostream>
 #include <algorithm>
+#include <new>
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "fmm.h"
+#include "bodies.h"
+#include "triplebuffer.h"
+#include "integrator.h"
+#include "blocksteps.h"
+#include "kepler.h"
+#include "field.h"
+#include "arena.h"
+#include "smoothing.h"
+#include "gridmesh.h"
+#include "spheres.h"
+#include "trails.h"
+#include "stars.h"
+#include "renderqueue.h"
 #ifdef __APPLE__
     #include <OpenGL/gl.h>
     #include <OpenGL/glu.h>
@@ -17,23 +36,34 @@ static const int kScreenW = 1600;
 static const int kScreenH = 1200;
 static const float kPhysicsHz = 120.0f;
 static const float kDt = 1.0f / kPhysicsHz;
-static const float kLinearDamping = 0.9992f;
-
-struct vec3d {
-    float x = 0.f, y = 0.f, z = 0.f;
-
-    vec3d() = default;
-    vec3d(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
-
-    vec3d operator+(const vec3d& o) const { return {x + o.x, y + o.y, z + o.z}; }
-    vec3d operator-(const vec3d& o) const { return {x - o.x, y - o.y, z - o.z}; }
-    vec3d operator*(float s) const { return {x * s, y * s, z * s}; }
-    vec3d operator/(float s) const { return {x / s, y / s, z / s}; }
-
-    vec3d& operator+=(const vec3d& o){ x += o.x; y += o.y; z += o.z; return *this; }
-    vec3d& operator-=(const vec3d& o){ x -= o.x; y -= o.y; z -= o.z; return *this; }
-    vec3d& operator*=(float s){ x *= s; y *= s; z *= s; return *this; }
+static const float kGravity = 200.0f;
+static const float kSoftening = 0.5f;
+static const float kBarnesHutTheta = 0.5f;
+static const int kMaxPhysicsSubsteps = 64;
+static const float kBlockMaxStep = 1.0f;     // longest block timestep
+static const float kBlockEta = 0.02f;        // block step = eta * |a| / |da/dt|
+static const size_t kFrameArenaBytes = 1 << 20;  // per-frame render scratch, grows if a frame needs more
+static const size_t kTrailLength = 800;
+static const int kAllocationWarmupFrames = 120;  // frames that may still size buffers before allocations count
+static const float kFieldOfViewY = 55.0f;    // degrees, as passed to gluPerspective
+static const float kNearPlane = 0.5f;
+static const float kFarPlane = 3000.0f;
+static const size_t kStarCount = 2000;          // GRAVITY_STARS overrides it
+static const uint64_t kStarSeed = 42;
+static const size_t kStarCacheMinimum = 100000;  // smaller catalogues generate faster than they load
+static const char* const kStarCachePath = "stars.cache";
+
+// Every sphere drawn for a body gets its own LOD key,
+// body index * SPHERE_ROLES + role (+ layer), so its level persists.
+enum SphereRole {
+    SPHERE_BODY = 0,
+    SPHERE_HALO = 1,
+    SPHERE_GLOW = 2,            // 5 sun glow layers
+    SPHERE_PRIMING = 7,         // 6 supernova priming layers
+    SPHERE_EXPLOSION = 13,      // 5 explosion shells
+    SPHERE_ROLES = 18
 };
+static inline uint32_t sphereKey(size_t body, int role) { return (uint32_t)(body * SPHERE_ROLES + role); }
 
 struct Camera {
     vec3d pos {0, 0, 300};
@@ -41,34 +71,30 @@ struct Camera {
     vec3d up {0, 1, 0};
 };
 
-struct Body {
-    vec3d pos, vel;
-    float radius, mass, invMass;
-    vec3d color;
+// what the physics thread publishes every tick: the state after the tick and
+// the positions before it, so frames that land between ticks can blend them
+struct BodySnapshot {
+    BodyStore bodies;
+    AlignedVector<float> prevX, prevY, prevZ;
+    double tickTime = 0.0;      // glfwGetTime() when the tick finished
 
-    Body(vec3d p, vec3d v, float m, float r, vec3d c)
-        : pos(p), vel(v), mass(m), radius(r), color(c)
-    {
-        invMass = (mass > 0.f) ? (1.f / mass) : 0.f;
+    void beginTick(const BodyStore& current) {
+        prevX = current.x; prevY = current.y; prevZ = current.z;
     }
 
-    void integrate(float dt){
-        pos += vel * dt;
-        vel *= kLinearDamping;
+    void endTick(const BodyStore& current, double time) {
+        bodies = current;
+        tickTime = time;
     }
 
-    void draw() const {
-        glPushMatrix();
-        glTranslatef(pos.x, pos.y, pos.z);
-
-        GLfloat matColor[] = { color.x, color.y, color.z, 1.0f };
-        glMaterialfv(GL_FRONT, GL_AMBIENT_AND_DIFFUSE, matColor);
-
-        GLUquadric* quad = gluNewQuadric();
-        gluSphere(quad, radius, 24, 24);
-        gluDeleteQuadric(quad);
-
-        glPopMatrix();
+    // alpha 0 is the state before the tick, 1 the state after it
+    void interpolate(float alpha, BodyStore& out) const {
+        out = bodies;
+        for (size_t i = 0; i < out.size(); ++i) {
+            out.x[i] = prevX[i] + (bodies.x[i] - prevX[i]) * alpha;
+            out.y[i] = prevY[i] + (bodies.y[i] - prevY[i]) * alpha;
+            out.z[i] = prevZ[i] + (bodies.z[i] - prevZ[i]) * alpha;
+        }
     }
 };
 
@@ -94,13 +120,6 @@ struct PerpendicularOrbiter {
         float z = radius * sinf(currentAngle) * sinf(tiltAngle);  
         return vec3d(x, y, z);
     }
-    
-    void update(float dt, float timeSpeed) {
-        currentAngle += angleVelocity * timeSpeed * dt;
-        while (currentAngle > 2.0f * 3.14159f) {
-            currentAngle -= 2.0f * 3.14159f;
-        }
-    }
 };
 
 struct OrbitParams {
@@ -114,6 +133,79 @@ struct OrbitParams {
     std::string name;
 };
 
+// physics backends, cycled with P
+enum PhysicsBackend {
+    SCRIPTED_ORBITS,      // Kepler paths from OrbitParams / PerpendicularOrbiter
+    DIRECT_GRAVITY,       // mutual gravity, O(n^2) direct summation
+    BARNES_HUT_GRAVITY,   // mutual gravity, octree with opening angle kBarnesHutTheta
+    FMM_GRAVITY,          // mutual gravity, fast multipole of order kFmmOrder
+    PHYSICS_BACKEND_COUNT
+};
+
+// solver state kept across steps so trees and expansions reuse their storage
+struct GravitySolvers {
+    Octree tree;
+    FmmSolver fmm{kFmmOrder};
+    BlockTimesteps blockSteps{kBlockMaxStep, kBlockEta};
+    ThreadPool pool;        // GRAVITY_THREADS overrides the core count
+    bool accelerationsValid = false;    // ax/ay/az match the current positions and backend
+
+    // another mutual-gravity backend takes over; block steps keep running,
+    // since their half kicks stay valid and only the next forces change.
+    // Stopping them mid-step would leave a velocity error of order a' h^2
+    // on every switch.
+    void switchForces() {
+        accelerationsValid = false;
+    }
+
+    // after the body state changed outside the integrator (scripted orbits
+    // took over or handed back); block-step velocities are half-kicked, so
+    // they are brought back to the current time before the scheduler
+    // restarts with a fresh opening kick
+    void invalidate(BodyStore& bodies) {
+        accelerationsValid = false;
+        blockSteps.synchronize(bodies);
+        blockSteps.reset();
+    }
+};
+
+enum GridBackend {
+    GRID_CPU_FIELD,       // CurvatureField on the CPU, smoothed, heights streamed to GridMesh
+    GRID_VERTEX_SHADER,   // raw field summed per vertex on the GPU, see GridMesh::drawField
+    GRID_BACKEND_COUNT
+};
+
+// spacetime grid state kept across frames; only the tiles near bodies that
+// moved are evaluated and smoothed again
+struct SpacetimeGrid {
+    CurvatureField field;
+    FieldGridCache cache;           // raw curvature per grid point
+    FieldGridCache rings;           // finer raw curvature in the orbital plane, sampled by the wave rings
+    CurvatureSmoother smoother;
+    std::vector<float> smoothed;    // what the grid draws, same layout as the cache
+    GridMesh mesh;
+    GridBackend backend = GRID_CPU_FIELD;
+
+    explicit SpacetimeGrid(ThreadPool* pool = nullptr) : field(pool) {}
+};
+
+// spacetime grid layout, shared by the grid and its wave rings
+static const int kGridSize = 120;               // cells per side
+static const float kGridSpacing = 15.0f;
+static const float kGridBaseZ = 15.0f;
+static const float kGridMaxCurvature = 60.0f;   // deepest bend
+static const float kNearPlanetRadius = 60.0f;   // reach of the smoothing mask around planets
+
+// Passes whose vertex data and commands are built on the thread pool, job
+// j into list 1 + j of the render queue; list 0 is the GL thread's.
+enum RecordJob {
+    RECORD_GRID,
+    RECORD_WAVE_RINGS,
+    RECORD_TRAILS,
+    RECORD_SUPERNOVA,
+    RECORD_JOB_COUNT
+};
+
 // Supernova system
 enum SupernovaState {
     NORMAL,
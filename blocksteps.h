@@ -0,0 +1,180 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+// Hierarchical power-of-two block timesteps (Aarseth). Body i steps with
+// dt_i = maxStep / 2^level_i, picked from dt = eta * |a| / |da/dt| so that it
+// follows the body's own orbital period. Time is counted in integer ticks of
+// maxStep / 2^kMaxLevel. At every tick where some bodies finish a step, all
+// positions drift to that tick, forces are evaluated for the finishing
+// bodies only, and those bodies get the closing and opening half kicks of
+// kick-drift-kick leapfrog.
+//
+// A body may halve its step at any sync point but only doubles it when the
+// longer step starts on the block grid, so active sets stay whole blocks.
+// Between sync points velocities are half-kicked; synchronize() brings them
+// back to the current time before another integrator takes over.
+//
+// The number of sync points per advance() is capped. When a call's time
+// would need more at the finest level, that level is coarsened until the
+// steps fit, the way a fixed-step integrator lengthens its substeps: fast
+// time loses accuracy rather than time.
+
+class BlockTimesteps {
+public:
+    static const int kMaxLevel = 12;
+
+    explicit BlockTimesteps(float longestStep = 1.0f, float accuracy = 0.02f)
+        : maxStep(longestStep), eta(accuracy) {}
+
+    bool running() const { return started; }
+    void reset() { started = false; }
+
+    // accelerations evaluated since the scheduler was created, one per target
+    uint64_t forceEvaluations() const { return evaluations; }
+
+    // time the bodies have drifted to since the last start
+    double time() const { return (double)now * tickLength(); }
+
+    // Advances by dt. computeForces(targets, count) must fill ax/ay/az for
+    // the listed bodies, or for every body when targets is nullptr. At most
+    // maxSyncPoints block boundaries are processed. Bodies above the level
+    // that fits are moved down as their blocks allow; time they leave
+    // unprocessed carries into the next call. Only more time than the cap
+    // covers at level 0 is dropped.
+    template <typename Store, typename Forces>
+    void advance(Store& bodies, float dt, int maxSyncPoints, const Forces& computeForces) {
+        if (!started || level.size() != bodies.size()) start(bodies, computeForces);
+        pendingTicks += (double)dt / tickLength();
+        finestLevel = fittingLevel(pendingTicks, maxSyncPoints);
+
+        for (int sync = 0; ; ++sync) {
+            uint64_t next = *std::min_element(nextTick.begin(), nextTick.end());
+            if ((double)(next - now) > pendingTicks) break;
+            if (sync == maxSyncPoints) {
+                double limit = (double)maxSyncPoints * (double)ticksAt(0);
+                if (pendingTicks > limit) {
+                    if (!warnedDropping) {
+                        std::cerr << "Block timesteps cannot keep up with this time speed, simulated time is dropped\n";
+                        warnedDropping = true;
+                    }
+                    pendingTicks = limit;
+                }
+                break;
+            }
+            pendingTicks -= (double)(next - now);
+            bodies.drift((float)((next - now) * tickLength()));
+            now = next;
+
+            active.clear();
+            for (size_t i = 0; i < nextTick.size(); ++i) {
+                if (nextTick[i] == now) active.push_back((uint32_t)i);
+            }
+            computeForces(active.data(), active.size());
+            evaluations += active.size();
+
+            for (uint32_t i : active) {
+                float h = stepLength(level[i]);
+                kick(bodies, i, 0.5f * h);
+
+                int wanted = std::min(levelFor(bodies, i, h), finestLevel);
+                int current = level[i];
+                if (wanted > current) current = wanted;
+                else if (current > finestLevel) {
+                    while (current > finestLevel && now % ticksAt(current - 1) == 0) current -= 1;
+                } else if (wanted < current && now % ticksAt(current - 1) == 0) current -= 1;
+                level[i] = (uint8_t)current;
+
+                kick(bodies, i, 0.5f * stepLength(current));
+                nextTick[i] = now + ticksAt(current);
+                prevAx[i] = bodies.ax[i]; prevAy[i] = bodies.ay[i]; prevAz[i] = bodies.az[i];
+            }
+        }
+    }
+
+    // Undoes the unfinished part of every opening half kick so velocities
+    // match the current time, then stops the scheduler.
+    template <typename Store>
+    void synchronize(Store& bodies) {
+        if (!started) return;
+        for (size_t i = 0; i < level.size(); ++i) {
+            uint64_t span = ticksAt(level[i]);
+            float elapsed = (float)((now - (nextTick[i] - span)) * tickLength());
+            float correction = elapsed - 0.5f * stepLength(level[i]);
+            bodies.vx[i] += prevAx[i] * correction;
+            bodies.vy[i] += prevAy[i] * correction;
+            bodies.vz[i] += prevAz[i] * correction;
+        }
+        started = false;
+    }
+
+private:
+    float maxStep;
+    float eta;
+
+    bool started = false;
+    uint64_t now = 0;
+    double pendingTicks = 0.0;
+    uint64_t evaluations = 0;
+    int finestLevel = kMaxLevel;        // finest level this call's time fits at
+    bool warnedDropping = false;
+
+    std::vector<uint8_t> level;
+    std::vector<uint64_t> nextTick;
+    std::vector<float> prevAx, prevAy, prevAz;     // accelerations at each body's last sync
+    std::vector<uint32_t> active;
+
+    double tickLength() const { return (double)maxStep / (double)(1u << kMaxLevel); }
+    static uint64_t ticksAt(int lvl) { return (uint64_t)1 << (kMaxLevel - lvl); }
+    float stepLength(int lvl) const { return (float)(ticksAt(lvl) * tickLength()); }
+
+    // finest level at which `ticks` take at most maxSyncPoints steps
+    static int fittingLevel(double ticks, int maxSyncPoints) {
+        int lvl = kMaxLevel;
+        while (lvl > 0 && ticks > (double)maxSyncPoints * (double)ticksAt(lvl)) --lvl;
+        return lvl;
+    }
+
+    template <typename Store>
+    static void kick(Store& bodies, size_t i, float dt) {
+        bodies.vx[i] += bodies.ax[i] * dt;
+        bodies.vy[i] += bodies.ay[i] * dt;
+        bodies.vz[i] += bodies.az[i] * dt;
+    }
+
+    // jerk from the change in acceleration over the step just finished
+    template <typename Store>
+    int levelFor(const Store& bodies, size_t i, float h) const {
+        float jx = bodies.ax[i] - prevAx[i], jy = bodies.ay[i] - prevAy[i], jz = bodies.az[i] - prevAz[i];
+        float jerk = std::sqrt(jx*jx + jy*jy + jz*jz) / h;
+        float accel = std::sqrt(bodies.ax[i]*bodies.ax[i] + bodies.ay[i]*bodies.ay[i] + bodies.az[i]*bodies.az[i]);
+        if (jerk <= 0.0f) return 0;
+
+        float wanted = eta * accel / jerk;
+        if (!(wanted > 0.0f)) return kMaxLevel;
+        int lvl = (int)std::ceil(std::log2(maxStep / wanted));
+        return std::max(0, std::min(lvl, kMaxLevel));
+    }
+
+    // every body starts on the finest level and climbs as its jerk is known
+    template <typename Store, typename Forces>
+    void start(Store& bodies, const Forces& computeForces) {
+        const size_t n = bodies.size();
+        computeForces(nullptr, n);
+        evaluations += n;
+
+        now = 0;
+        pendingTicks = 0.0;
+        level.assign(n, (uint8_t)kMaxLevel);
+        nextTick.assign(n, ticksAt(kMaxLevel));
+        prevAx.assign(bodies.ax.begin(), bodies.ax.end());
+        prevAy.assign(bodies.ay.begin(), bodies.ay.end());
+        prevAz.assign(bodies.az.begin(), bodies.az.end());
+        for (size_t i = 0; i < n; ++i) kick(bodies, i, 0.5f * stepLength(kMaxLevel));
+        started = true;
+    }
+};
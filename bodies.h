@@ -0,0 +1,142 @@
+#pragma once
+#include <new>
+#include <vector>
+#include <cstddef>
+#include "gravity.h"
+#include "integrator.h"
+
+// The 3D simulator's bodies, kept free of GL so physics loops and the
+// benchmarks can use them without a window.
+
+static const size_t kCacheLine = 64;
+
+struct vec3d {
+    float x = 0.f, y = 0.f, z = 0.f;
+
+    vec3d() = default;
+    vec3d(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
+
+    vec3d operator+(const vec3d& o) const { return {x + o.x, y + o.y, z + o.z}; }
+    vec3d operator-(const vec3d& o) const { return {x - o.x, y - o.y, z - o.z}; }
+    vec3d operator*(float s) const { return {x * s, y * s, z * s}; }
+    vec3d operator/(float s) const { return {x / s, y / s, z / s}; }
+
+    vec3d& operator+=(const vec3d& o){ x += o.x; y += o.y; z += o.z; return *this; }
+    vec3d& operator-=(const vec3d& o){ x -= o.x; y -= o.y; z -= o.z; return *this; }
+    vec3d& operator*=(float s){ x *= s; y *= s; z *= s; return *this; }
+};
+
+struct Body {
+    vec3d pos, vel;
+    float radius, mass;
+    vec3d color;
+
+    Body(vec3d p, vec3d v, float m, float r, vec3d c)
+        : pos(p), vel(v), radius(r), mass(m), color(c) {}
+};
+
+// cache-line aligned allocator so every BodyStore field starts on its own line
+template <typename T>
+struct AlignedAllocator {
+    using value_type = T;
+
+    AlignedAllocator() = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(kCacheLine)));
+    }
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(kCacheLine));
+    }
+
+    template <typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// lightweight (store, index) handle; setters only compile on a non-const store
+template <typename Store>
+struct BodyHandle {
+    Store* store;
+    size_t index;
+
+    vec3d pos() const { return vec3d(store->x[index], store->y[index], store->z[index]); }
+    vec3d vel() const { return vec3d(store->vx[index], store->vy[index], store->vz[index]); }
+    float mass() const { return store->mass[index]; }
+    float radius() const { return store->radius[index]; }
+    const vec3d& color() const { return store->color[index]; }
+
+    void setPos(const vec3d& p) const { store->x[index] = p.x; store->y[index] = p.y; store->z[index] = p.z; }
+    void setVel(const vec3d& v) const { store->vx[index] = v.x; store->vy[index] = v.y; store->vz[index] = v.z; }
+
+    operator BodyHandle<const Store>() const { return BodyHandle<const Store>{store, index}; }
+};
+
+struct BodyStore;
+using BodyRef = BodyHandle<BodyStore>;
+using ConstBodyRef = BodyHandle<const BodyStore>;
+
+// structure-of-arrays body storage: physics and field loops stream only the
+// fields they read, color is kept apart since only drawing touches it
+struct BodyStore {
+    AlignedVector<float> x, y, z;
+    AlignedVector<float> vx, vy, vz;
+    AlignedVector<float> ax, ay, az;
+    AlignedVector<float> mass, radius;
+    std::vector<vec3d> color;
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+
+    void reserve(size_t n) {
+        x.reserve(n); y.reserve(n); z.reserve(n);
+        vx.reserve(n); vy.reserve(n); vz.reserve(n);
+        ax.reserve(n); ay.reserve(n); az.reserve(n);
+        mass.reserve(n); radius.reserve(n);
+        color.reserve(n);
+    }
+
+    void push_back(const Body& b) {
+        x.push_back(b.pos.x); y.push_back(b.pos.y); z.push_back(b.pos.z);
+        vx.push_back(b.vel.x); vy.push_back(b.vel.y); vz.push_back(b.vel.z);
+        ax.push_back(0.f); ay.push_back(0.f); az.push_back(0.f);
+        mass.push_back(b.mass);
+        radius.push_back(b.radius);
+        color.push_back(b.color);
+    }
+
+    Body get(size_t i) const {
+        return Body(vec3d(x[i], y[i], z[i]), vec3d(vx[i], vy[i], vz[i]), mass[i], radius[i], color[i]);
+    }
+
+    vec3d pos(size_t i) const { return vec3d(x[i], y[i], z[i]); }
+    void setPos(size_t i, const vec3d& p) { x[i] = p.x; y[i] = p.y; z[i] = p.z; }
+
+    void kick(float dt) {
+        for (size_t i = 0; i < size(); ++i) {
+            vx[i] += ax[i] * dt; vy[i] += ay[i] * dt; vz[i] += az[i] * dt;
+        }
+    }
+
+    void drift(float dt) {
+        for (size_t i = 0; i < size(); ++i) {
+            x[i] += vx[i] * dt; y[i] += vy[i] * dt; z[i] += vz[i] * dt;
+        }
+    }
+
+    // one step of `integrator`, see integrateStep
+    template <typename Forces>
+    void step(Integrator integrator, float dt, const Forces& computeForces) {
+        integrateStep(*this, integrator, dt, computeForces);
+    }
+
+    GravitySystem gravitySystem() {
+        return GravitySystem{x.data(), y.data(), z.data(), mass.data(), ax.data(), ay.data(), az.data(), size(), nullptr, 0};
+    }
+
+    BodyRef operator[](size_t i) { return BodyRef{this, i}; }
+    ConstBodyRef operator[](size_t i) const { return ConstBodyRef{this, i}; }
+};
@@ -0,0 +1,390 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "simd.h"
+#include "threadpool.h"
+
+// Spacetime curvature field behind the grid and the gravity-wave rings.
+//
+// Every body adds, within its influence radius R,
+//   local  L * max(0, 1 - 2d/R)^2
+//   broad  m * B * (1 - d/R)^3 / (d^2 + 3)
+//   spike  30 e^(-d/8) for planets closer than 25
+//   bowl   10 e^(-d/50) for stars
+// where R, B and L come from the body's tier (star, giant, large, small).
+// update() resolves the tiers once per frame into flat per-body terms, so
+// the inner loops have no branches. Bodies are also binned on a 2D grid with
+// cells at least as wide as the largest reach, so a query only visits the
+// bins around it. Grids are cut into square tiles, each tile keeps only the
+// bodies whose reach touches its bounding box, and the tiles run in parallel
+// with 8 grid points per vector. Grid points sum their bodies in index order,
+// so results do not depend on the thread count.
+
+struct FieldGrid {
+    float originX, originY;     // position of point (0, 0)
+    float spacing;
+    float z;                    // height of the grid plane
+    int nx, ny;                 // point (i, j) is written to out[i * ny + j]
+};
+
+class CurvatureField {
+public:
+    static const int kTile = 16;            // grid points per tile side
+    static const int kMaxBinsPerAxis = 256;
+    static constexpr float kStarMass = 500.0f;
+
+    explicit CurvatureField(ThreadPool* threadPool = nullptr) : pool(threadPool) {}
+
+    size_t size() const { return x.size(); }
+
+    // takes positions and tiers from any store with x/y/z/mass/radius arrays
+    template <typename Store>
+    void update(const Store& bodies) {
+        const size_t n = bodies.size();
+        x.resize(n); y.resize(n); z.resize(n);
+        reach.resize(n); invReach.resize(n); invHalfReach.resize(n);
+        localScale.resize(n); broadScale.resize(n); spikeScale.resize(n); bowlScale.resize(n);
+
+        for (size_t i = 0; i < n; ++i) {
+            float mass = bodies.mass[i], radius = bodies.radius[i];
+            float R, base, local;
+            if (mass > kStarMass)     { R = 160.0f; base = 20.0f; local = 12.0f; }
+            else if (radius > 22.0f)  { R = 95.0f;  base = 65.0f; local = 50.0f; }
+            else if (radius > 15.0f)  { R = 75.0f;  base = 60.0f; local = 45.0f; }
+            else                      { R = 55.0f;  base = 55.0f; local = 40.0f; }
+
+            x[i] = bodies.x[i]; y[i] = bodies.y[i]; z[i] = bodies.z[i];
+            reach[i] = R;
+            invReach[i] = 1.0f / R;
+            invHalfReach[i] = 2.0f / R;
+            localScale[i] = local;
+            broadScale[i] = mass * base;
+            spikeScale[i] = (mass > kStarMass) ? 0.0f : 30.0f;
+            bowlScale[i] = (mass > kStarMass) ? 10.0f : 0.0f;
+        }
+        buildBins();
+    }
+
+    // reach of body i, the distance beyond which it adds nothing
+    float influenceRadius(size_t i) const { return reach[i]; }
+
+    float at(float px, float py, float pz) const {
+        float total = 0.0f;
+        forBodiesNear(px, px, py, py, [&](uint32_t i) { total += contribution(i, px, py, pz); });
+        return total;
+    }
+
+    void evaluateGrid(const FieldGrid& grid, float* out) const {
+        evaluateTiles(grid, nullptr, tileCount(grid), out);
+    }
+
+    // evaluates only the listed tiles, numbered t = ti * tilesY + tj;
+    // all tiles when tiles is nullptr
+    void evaluateTiles(const FieldGrid& grid, const uint32_t* tiles, size_t count, float* out) const {
+        const int tilesY = (grid.ny + kTile - 1) / kTile;
+        forEachTile(pool, count, 1, [&](size_t begin, size_t end) {
+            static thread_local std::vector<uint32_t> candidates;
+            for (size_t k = begin; k < end; ++k) {
+                size_t t = tiles ? tiles[k] : k;
+                int i0 = (int)(t / tilesY) * kTile, j0 = (int)(t % tilesY) * kTile;
+                int i1 = std::min(i0 + kTile, grid.nx), j1 = std::min(j0 + kTile, grid.ny);
+                cullTile(grid, i0, i1, j0, j1, candidates);
+                evaluateTile(grid, i0, i1, j0, j1, candidates, out);
+            }
+        });
+    }
+
+    static size_t tileCount(const FieldGrid& grid) {
+        return (size_t)((grid.nx + kTile - 1) / kTile) * ((grid.ny + kTile - 1) / kTile);
+    }
+
+    // where body i sits and how hard it pulls; equal footprints add equal terms
+    struct Footprint {
+        float x, y, z, reach, strength;
+        bool operator==(const Footprint& o) const {
+            return x == o.x && y == o.y && z == o.z && reach == o.reach && strength == o.strength;
+        }
+    };
+    Footprint footprint(size_t i) const { return {x[i], y[i], z[i], reach[i], broadScale[i]}; }
+
+private:
+    ThreadPool* pool;
+    std::vector<float> x, y, z;
+    std::vector<float> reach, invReach, invHalfReach;
+    std::vector<float> localScale, broadScale, spikeScale, bowlScale;
+
+    // bodies of bin (bx, by) are binBodies[binStart[b]..binStart[b + 1]), b = by * binsX + bx
+    float maxReach = 0.0f;
+    float binMinX = 0.0f, binMinY = 0.0f, binSize = 1.0f;
+    int binsX = 0, binsY = 0;
+    std::vector<uint32_t> binStart, binBodies, binFill;
+
+    void buildBins() {
+        const size_t n = x.size();
+        binsX = binsY = 0;
+        if (n == 0) return;
+
+        float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+        maxReach = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+            minY = std::min(minY, y[i]); maxY = std::max(maxY, y[i]);
+            maxReach = std::max(maxReach, reach[i]);
+        }
+        float extent = std::max(maxX - minX, maxY - minY);
+        binSize = std::max(maxReach, extent / (float)(kMaxBinsPerAxis - 1));
+        binMinX = minX;
+        binMinY = minY;
+        binsX = (int)((maxX - minX) / binSize) + 1;
+        binsY = (int)((maxY - minY) / binSize) + 1;
+
+        // the bin count follows the bodies' spread; reserving the cap once
+        // keeps a spreading system from reallocating frame after frame
+        size_t maxBins = (size_t)kMaxBinsPerAxis * kMaxBinsPerAxis + 1;
+        if (binStart.capacity() < (size_t)binsX * binsY + 1) {
+            binStart.reserve(maxBins);
+            binFill.reserve(maxBins);
+        }
+
+        // counting sort keeps each bin in body index order
+        binStart.assign((size_t)binsX * binsY + 1, 0);
+        for (size_t i = 0; i < n; ++i) ++binStart[binOf(i) + 1];
+        for (size_t b = 0; b + 1 < binStart.size(); ++b) binStart[b + 1] += binStart[b];
+        binFill.assign(binStart.begin(), binStart.end() - 1);
+        binBodies.resize(n);
+        for (size_t i = 0; i < n; ++i) binBodies[binFill[binOf(i)]++] = (uint32_t)i;
+    }
+
+    size_t binOf(size_t i) const {
+        int bx = std::min((int)((x[i] - binMinX) / binSize), binsX - 1);
+        int by = std::min((int)((y[i] - binMinY) / binSize), binsY - 1);
+        return (size_t)by * binsX + bx;
+    }
+
+    // every body whose reach may touch the rectangle, bin by bin
+    template <typename Visit>
+    void forBodiesNear(float minX, float maxX, float minY, float maxY, const Visit& visit) const {
+        if (binsX == 0) return;
+        int bx0 = std::max(0, (int)std::floor((minX - maxReach - binMinX) / binSize));
+        int bx1 = std::min(binsX - 1, (int)std::floor((maxX + maxReach - binMinX) / binSize));
+        int by0 = std::max(0, (int)std::floor((minY - maxReach - binMinY) / binSize));
+        int by1 = std::min(binsY - 1, (int)std::floor((maxY + maxReach - binMinY) / binSize));
+        for (int by = by0; by <= by1; ++by) {
+            for (int bx = bx0; bx <= bx1; ++bx) {
+                size_t b = (size_t)by * binsX + bx;
+                for (uint32_t k = binStart[b]; k < binStart[b + 1]; ++k) visit(binBodies[k]);
+            }
+        }
+    }
+
+    float contribution(size_t i, float px, float py, float pz) const {
+        float dx = px - x[i], dy = py - y[i], dz = pz - z[i];
+        float d = std::max(std::sqrt(dx*dx + dy*dy + dz*dz), 1e-6f);
+        if (d > reach[i]) return 0.0f;
+
+        float local = std::max(0.0f, 1.0f - d * invHalfReach[i]);
+        float broad = 1.0f - d * invReach[i];
+        float influence = localScale[i] * local * local;
+        influence += broadScale[i] * broad * broad * broad / (d * d + 3.0f);
+        if (d < 25.0f) influence += spikeScale[i] * std::exp(-d / 8.0f);
+        influence += bowlScale[i] * std::exp(-d / 50.0f);
+        return influence;
+    }
+
+    void cullTile(const FieldGrid& grid, int i0, int i1, int j0, int j1, std::vector<uint32_t>& candidates) const {
+        float minX = grid.originX + i0 * grid.spacing, maxX = grid.originX + (i1 - 1) * grid.spacing;
+        float minY = grid.originY + j0 * grid.spacing, maxY = grid.originY + (j1 - 1) * grid.spacing;
+        candidates.clear();
+        forBodiesNear(minX, maxX, minY, maxY, [&](uint32_t i) {
+            float ox = std::max(0.0f, std::max(minX - x[i], x[i] - maxX));
+            float oy = std::max(0.0f, std::max(minY - y[i], y[i] - maxY));
+            float oz = grid.z - z[i];
+            if (ox*ox + oy*oy + oz*oz <= reach[i] * reach[i]) candidates.push_back(i);
+        });
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    void evaluateTile(const FieldGrid& grid, int i0, int i1, int j0, int j1,
+                      const std::vector<uint32_t>& candidates, float* out) const {
+#if GRAVITY_SIMD_X86
+        if (simdLevel() != SIMD_SCALAR) {
+            evaluateTileAvx2(grid, i0, i1, j0, j1, candidates, out);
+            return;
+        }
+#endif
+        for (int i = i0; i < i1; ++i) {
+            for (int j = j0; j < j1; ++j) out[(size_t)i * grid.ny + j] = pointSum(grid, i, j, candidates);
+        }
+    }
+
+    float pointSum(const FieldGrid& grid, int i, int j, const std::vector<uint32_t>& candidates) const {
+        float px = grid.originX + i * grid.spacing, py = grid.originY + j * grid.spacing;
+        float total = 0.0f;
+        for (uint32_t b : candidates) total += contribution(b, px, py, grid.z);
+        return total;
+    }
+
+#if GRAVITY_SIMD_X86
+    // cephes expf: e^v = 2^k * e^r with |r| <= ln2 / 2
+    SIMD_TARGET_AVX2 static inline __m256 expAvx2(__m256 v) {
+        v = _mm256_max_ps(v, _mm256_set1_ps(-87.0f));
+        __m256 k = _mm256_floor_ps(_mm256_fmadd_ps(v, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+        __m256 r = _mm256_fnmadd_ps(k, _mm256_set1_ps(0.693359375f), v);
+        r = _mm256_fnmadd_ps(k, _mm256_set1_ps(-2.12194440e-4f), r);
+
+        __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+        p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+        __m256i scale = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(k), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(scale));
+    }
+
+    SIMD_TARGET_AVX2 void evaluateTileAvx2(const FieldGrid& grid, int i0, int i1, int j0, int j1,
+                                           const std::vector<uint32_t>& candidates, float* out) const {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 three = _mm256_set1_ps(3.0f);
+        const __m256 minDistance = _mm256_set1_ps(1e-6f);
+        const __m256 spikeRange = _mm256_set1_ps(25.0f);
+        const __m256 spikeRate = _mm256_set1_ps(-1.0f / 8.0f);
+        const __m256 bowlRate = _mm256_set1_ps(-1.0f / 50.0f);
+        const __m256 laneOffsets = _mm256_mul_ps(_mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_ps(grid.spacing));
+
+        for (int i = i0; i < i1; ++i) {
+            const float px = grid.originX + i * grid.spacing;
+            int j = j0;
+            for (; j + 8 <= j1; j += 8) {
+                __m256 py = _mm256_add_ps(_mm256_set1_ps(grid.originY + j * grid.spacing), laneOffsets);
+                __m256 total = zero;
+
+                for (uint32_t b : candidates) {
+                    __m256 dx = _mm256_set1_ps(px - x[b]);
+                    __m256 dy = _mm256_sub_ps(py, _mm256_set1_ps(y[b]));
+                    float dzs = grid.z - z[b];
+                    __m256 d2 = _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dx, dx, _mm256_set1_ps(dzs * dzs)));
+                    __m256 d = _mm256_max_ps(_mm256_sqrt_ps(d2), minDistance);
+
+                    __m256 local = _mm256_max_ps(zero, _mm256_fnmadd_ps(d, _mm256_set1_ps(invHalfReach[b]), one));
+                    __m256 broad = _mm256_fnmadd_ps(d, _mm256_set1_ps(invReach[b]), one);
+                    __m256 influence = _mm256_mul_ps(_mm256_set1_ps(localScale[b]), _mm256_mul_ps(local, local));
+                    __m256 broad3 = _mm256_mul_ps(broad, _mm256_mul_ps(broad, broad));
+                    influence = _mm256_add_ps(influence, _mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps(broadScale[b]), broad3),
+                                                                       _mm256_fmadd_ps(d, d, three)));
+                    if (spikeScale[b] != 0.0f) {
+                        __m256 spike = _mm256_mul_ps(_mm256_set1_ps(spikeScale[b]), expAvx2(_mm256_mul_ps(d, spikeRate)));
+                        influence = _mm256_add_ps(influence, _mm256_and_ps(spike, _mm256_cmp_ps(d, spikeRange, _CMP_LT_OQ)));
+                    }
+                    if (bowlScale[b] != 0.0f) {
+                        influence = _mm256_fmadd_ps(_mm256_set1_ps(bowlScale[b]), expAvx2(_mm256_mul_ps(d, bowlRate)), influence);
+                    }
+
+                    __m256 inside = _mm256_cmp_ps(d, _mm256_set1_ps(reach[b]), _CMP_LE_OQ);
+                    total = _mm256_add_ps(total, _mm256_and_ps(influence, inside));
+                }
+                _mm256_storeu_ps(out + (size_t)i * grid.ny + j, total);
+            }
+            for (; j < j1; ++j) out[(size_t)i * grid.ny + j] = pointSum(grid, i, j, candidates);
+        }
+    }
+#endif
+};
+
+// Field values on a fixed grid, kept across frames. A body that moved or
+// changed tier dirties the tiles under its old and its new footprint; only
+// those tiles are evaluated again, everything else is reused. Footprints are
+// widened to at least minRadius so callers can also cover their own effects
+// that reach further than the field, such as smoothing masks.
+class FieldGridCache {
+public:
+    const std::vector<float>& values() const { return data; }
+    const FieldGrid& layout() const { return grid; }
+    size_t dirtyTiles() const { return dirty.size(); }
+
+    void update(const FieldGrid& newGrid, const CurvatureField& field, float minRadius = 0.0f) {
+        const size_t n = field.size();
+        const bool resized = newGrid.nx != grid.nx || newGrid.ny != grid.ny;
+        if (resized || newGrid.originX != grid.originX || newGrid.originY != grid.originY ||
+            newGrid.spacing != grid.spacing || newGrid.z != grid.z || n != previous.size()) {
+            grid = newGrid;
+            if (resized) data.assign((size_t)grid.nx * grid.ny, 0.0f);
+            tileDirty.assign(CurvatureField::tileCount(grid), 1);
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                CurvatureField::Footprint now = field.footprint(i);
+                if (now == previous[i]) continue;
+                markDisc(previous[i], minRadius);
+                markDisc(now, minRadius);
+            }
+        }
+
+        previous.resize(n);
+        for (size_t i = 0; i < n; ++i) previous[i] = field.footprint(i);
+
+        dirty.clear();
+        for (size_t t = 0; t < tileDirty.size(); ++t) {
+            if (tileDirty[t]) dirty.push_back((uint32_t)t);
+        }
+        field.evaluateTiles(grid, dirty.data(), dirty.size(), data.data());
+        std::fill(tileDirty.begin(), tileDirty.end(), 0);
+    }
+
+    // bilinear interpolation between the four surrounding points; false
+    // when (px, py) lies outside the grid
+    bool sample(float px, float py, float& value) const {
+        float u = (px - grid.originX) / grid.spacing, v = (py - grid.originY) / grid.spacing;
+        if (!(u >= 0.0f && v >= 0.0f && u < (float)(grid.nx - 1) && v < (float)(grid.ny - 1))) return false;
+        int i = (int)u, j = (int)v;
+        float fu = u - (float)i, fv = v - (float)j;
+        const float* row0 = &data[(size_t)i * grid.ny + j];
+        const float* row1 = row0 + grid.ny;
+        float lower = row0[0] + (row0[1] - row0[0]) * fv;
+        float upper = row1[0] + (row1[1] - row1[0]) * fv;
+        value = lower + (upper - lower) * fu;
+        return true;
+    }
+
+    // point ranges [i0, i1) x [j0, j1) of the tiles redone by the last
+    // update(), grown by border points on every side and clipped to the grid
+    template <typename Region>
+    void forEachDirtyRegion(int border, const Region& region) const {
+        const int tilesY = (grid.ny + kTile - 1) / kTile;
+        for (uint32_t t : dirty) {
+            int i0 = (int)(t / tilesY) * kTile, j0 = (int)(t % tilesY) * kTile;
+            region(std::max(0, i0 - border), std::min(grid.nx, i0 + kTile + border),
+                   std::max(0, j0 - border), std::min(grid.ny, j0 + kTile + border));
+        }
+    }
+
+private:
+    static const int kTile = CurvatureField::kTile;
+
+    FieldGrid grid = {0.0f, 0.0f, 0.0f, 0.0f, 0, 0};
+    std::vector<float> data;
+    std::vector<uint8_t> tileDirty;
+    std::vector<uint32_t> dirty;
+    std::vector<CurvatureField::Footprint> previous;
+
+    void markDisc(const CurvatureField::Footprint& body, float minRadius) {
+        float r = std::max(body.reach, minRadius);
+        // clamp in float first so far away bodies cannot overflow the casts
+        auto cell = [](float v, int count) { return (int)std::min(std::max(v, -1.0f), (float)count); };
+        int i0 = std::max(0, cell(std::floor((body.x - r - grid.originX) / grid.spacing), grid.nx));
+        int i1 = std::min(grid.nx - 1, cell(std::ceil((body.x + r - grid.originX) / grid.spacing), grid.nx));
+        int j0 = std::max(0, cell(std::floor((body.y - r - grid.originY) / grid.spacing), grid.ny));
+        int j1 = std::min(grid.ny - 1, cell(std::ceil((body.y + r - grid.originY) / grid.spacing), grid.ny));
+        if (i0 > i1 || j0 > j1) return;
+
+        const int tilesY = (grid.ny + kTile - 1) / kTile;
+        for (int ti = i0 / kTile; ti <= i1 / kTile; ++ti) {
+            for (int tj = j0 / kTile; tj <= j1 / kTile; ++tj) tileDirty[(size_t)ti * tilesY + tj] = 1;
+        }
+    }
+};
@@ -0,0 +1,382 @@
+#pragma once
+#include "gravity.h"
+
+// Cartesian fast multipole method.
+//
+// Expansions are in monomials d^k = dx^kx * dy^ky * dz^kz of total order
+// |k| <= p. A cell's multipole about its center c is M_k = sum m_j (x_j - c)^k,
+// so the far potential is phi(t) = sum_k b_k(t - c) M_k, where b_k(R) are the
+// Taylor coefficients of 1/|R - h| in h. They obey the recurrence
+//   |k| R^2 b_k = (2|k| - 1) sum_i R_i b_{k-e_i} - (|k| - 1) sum_i b_{k-2e_i}
+// which holds unchanged for the softened 1/sqrt(|R - h|^2 + eps^2) with
+// R^2 + eps^2 in place of R^2, so far and near interactions use the same kernel.
+// A dual tree walk turns well separated cell pairs into M2L translations and
+// everything else into leaf-leaf direct sums, which keeps the cost O(n).
+// The error falls roughly as theta^(p+1).
+
+static const int kMaxFmmOrder = 16;
+static const int kFmmOrder = 10;        // what the simulator's FMM backend runs at
+static const float kFmmTheta = 0.4f;
+static const int kMaxFmmTerms = (kMaxFmmOrder + 1) * (kMaxFmmOrder + 2) * (kMaxFmmOrder + 3) / 6;
+
+class FmmSolver {
+public:
+    explicit FmmSolver(int expansionOrder = 8) { setOrder(expansionOrder); }
+
+    int order() const { return p; }
+
+    void setOrder(int expansionOrder) {
+        p = std::max(1, std::min(expansionOrder, kMaxFmmOrder));
+        buildTerms();
+        buildPlans();
+    }
+
+    // params.theta is the separation test (Ra + Rb) < theta * distance
+    // With a pool, every phase except M2M and L2L runs per target cell, and
+    // each cell sums its sources in traversal order, so results do not depend
+    // on the thread count. sys.targets is ignored: the expansions cost the
+    // same for any subset, so every body gets a new acceleration.
+    void compute(const GravitySystem& sys, const GravityParams& params, ThreadPool* pool = nullptr) {
+        if (sys.count == 0) return;
+
+        tree.build(sys.x, sys.y, sys.z, sys.mass, sys.count, kLeafSize);
+        const size_t nodeCount = tree.nodes.size();
+
+        centers.assign(nodeCount * 3, 0.0);
+        radii.assign(nodeCount, 0.0);
+        multipoles.assign(nodeCount * nterms, 0.0);
+        locals.assign(nodeCount * nterms, 0.0);
+        accX.assign(sys.count, 0.0);
+        accY.assign(sys.count, 0.0);
+        accZ.assign(sys.count, 0.0);
+
+        leaves.clear();
+        for (size_t n = 0; n < nodeCount; ++n) {
+            if (tree.nodes[n].leaf) leaves.push_back((uint32_t)n);
+        }
+
+        upwardPass(pool);
+
+        m2lPairs.clear();
+        p2pPairs.clear();
+        interact(0, 0, params.theta);
+        groupByTarget(m2lPairs, m2lOffsets, m2lSources);
+        groupByTarget(p2pPairs, p2pOffsets, p2pSources);
+
+        forEachTile(pool, nodeCount, kCellTile, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                for (uint32_t e = m2lOffsets[t]; e < m2lOffsets[t + 1]; ++e) {
+                    m2l((uint32_t)t, m2lSources[e], params.softening);
+                }
+            }
+        });
+        forEachTile(pool, nodeCount, kCellTile, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; ++t) {
+                for (uint32_t e = p2pOffsets[t]; e < p2pOffsets[t + 1]; ++e) {
+                    p2p((uint32_t)t, p2pSources[e], params.softening);
+                }
+            }
+        });
+
+        downwardPass(pool);
+
+        for (size_t k = 0; k < sys.count; ++k) {
+            uint32_t i = tree.order[k];
+            sys.ax[i] = (float)(params.G * accX[k]);
+            sys.ay[i] = (float)(params.G * accY[k]);
+            sys.az[i] = (float)(params.G * accZ[k]);
+        }
+    }
+
+private:
+    static const uint32_t kLeafSize = 64;
+    static const size_t kCellTile = 16;
+
+    // out[t] += sum over entries e in [offsets[t], offsets[t+1]) of coef[e] * A[a[e]] * B[b[e]]
+    struct TranslationPlan {
+        std::vector<uint32_t> offsets;
+        std::vector<uint16_t> a, b;
+        std::vector<double> coef;
+
+        void clear() { offsets.assign(1, 0); a.clear(); b.clear(); coef.clear(); }
+        void add(int ia, int ib, double c) { a.push_back((uint16_t)ia); b.push_back((uint16_t)ib); coef.push_back(c); }
+        void endTerm() { offsets.push_back((uint32_t)a.size()); }
+
+        void apply(const double* A, const double* B, double* out) const {
+            const size_t terms = offsets.size() - 1;
+            for (size_t t = 0; t < terms; ++t) {
+                double sum = 0.0;
+                for (uint32_t e = offsets[t]; e < offsets[t + 1]; ++e) sum += coef[e] * A[a[e]] * B[b[e]];
+                out[t] += sum;
+            }
+        }
+    };
+
+    int p = 0;
+    int nterms = 0;
+    std::vector<int> ex, ey, ez;        // exponents of each term
+    std::vector<int> lookup;            // (p+1)^3 exponent table -> term, -1 if |k| > p
+    std::vector<int> minus1[3];         // term of k - e_i, -1 if none
+    std::vector<int> minus2[3];         // term of k - 2e_i, -1 if none
+    TranslationPlan m2mPlan, m2lPlan, l2lPlan;
+
+    Octree tree;
+    std::vector<double> centers, radii;
+    std::vector<double> multipoles, locals;
+    std::vector<double> accX, accY, accZ;
+    std::vector<uint32_t> leaves;
+    std::vector<std::pair<uint32_t, uint32_t>> m2lPairs, p2pPairs;
+    std::vector<uint32_t> m2lOffsets, m2lSources;   // sources of each target cell
+    std::vector<uint32_t> p2pOffsets, p2pSources;
+    std::vector<uint32_t> fillCursor;
+
+    int term(int i, int j, int k) const {
+        if (i < 0 || j < 0 || k < 0 || i + j + k > p) return -1;
+        return lookup[(i * (p + 1) + j) * (p + 1) + k];
+    }
+
+    static double binomial(int n, int k) {
+        double r = 1.0;
+        for (int i = 1; i <= k; ++i) r = r * (double)(n - k + i) / (double)i;
+        return r;
+    }
+
+    void buildTerms() {
+        ex.clear(); ey.clear(); ez.clear();
+        lookup.assign((p + 1) * (p + 1) * (p + 1), -1);
+        for (int n = 0; n <= p; ++n) {
+            for (int i = n; i >= 0; --i) {
+                for (int j = n - i; j >= 0; --j) {
+                    int k = n - i - j;
+                    lookup[(i * (p + 1) + j) * (p + 1) + k] = (int)ex.size();
+                    ex.push_back(i); ey.push_back(j); ez.push_back(k);
+                }
+            }
+        }
+        nterms = (int)ex.size();
+
+        for (int axis = 0; axis < 3; ++axis) {
+            minus1[axis].assign(nterms, -1);
+            minus2[axis].assign(nterms, -1);
+        }
+        for (int t = 0; t < nterms; ++t) {
+            minus1[0][t] = term(ex[t] - 1, ey[t], ez[t]);
+            minus1[1][t] = term(ex[t], ey[t] - 1, ez[t]);
+            minus1[2][t] = term(ex[t], ey[t], ez[t] - 1);
+            minus2[0][t] = term(ex[t] - 2, ey[t], ez[t]);
+            minus2[1][t] = term(ex[t], ey[t] - 2, ez[t]);
+            minus2[2][t] = term(ex[t], ey[t], ez[t] - 2);
+        }
+    }
+
+    void buildPlans() {
+        m2mPlan.clear(); m2lPlan.clear(); l2lPlan.clear();
+
+        // M2M: M_k(parent) += C(k, i) * M_i(child) * shift^(k - i)
+        for (int k = 0; k < nterms; ++k) {
+            for (int i = 0; i < nterms; ++i) {
+                if (ex[i] > ex[k] || ey[i] > ey[k] || ez[i] > ez[k]) continue;
+                double c = binomial(ex[k], ex[i]) * binomial(ey[k], ey[i]) * binomial(ez[k], ez[i]);
+                m2mPlan.add(i, term(ex[k] - ex[i], ey[k] - ey[i], ez[k] - ez[i]), c);
+            }
+            m2mPlan.endTerm();
+        }
+
+        // L2L: L_m(child) += C(l, m) * L_l(parent) * shift^(l - m)
+        for (int m = 0; m < nterms; ++m) {
+            for (int l = 0; l < nterms; ++l) {
+                if (ex[m] > ex[l] || ey[m] > ey[l] || ez[m] > ez[l]) continue;
+                double c = binomial(ex[l], ex[m]) * binomial(ey[l], ey[m]) * binomial(ez[l], ez[m]);
+                l2lPlan.add(l, term(ex[l] - ex[m], ey[l] - ey[m], ez[l] - ez[m]), c);
+            }
+            l2lPlan.endTerm();
+        }
+
+        // M2L: L_l += (-1)^|l| * C(k + l, l) * M_k * b_{k+l}(R)
+        for (int l = 0; l < nterms; ++l) {
+            int nl = ex[l] + ey[l] + ez[l];
+            double sign = (nl & 1) ? -1.0 : 1.0;
+            for (int k = 0; k < nterms; ++k) {
+                int sum = term(ex[k] + ex[l], ey[k] + ey[l], ez[k] + ez[l]);
+                if (sum < 0) continue;
+                double c = binomial(ex[k] + ex[l], ex[l]) * binomial(ey[k] + ey[l], ey[l]) * binomial(ez[k] + ez[l], ez[l]);
+                m2lPlan.add(k, sum, sign * c);
+            }
+            m2lPlan.endTerm();
+        }
+    }
+
+    void monomials(double x, double y, double z, double* out) const {
+        double px[kMaxFmmOrder + 1], py[kMaxFmmOrder + 1], pz[kMaxFmmOrder + 1];
+        px[0] = py[0] = pz[0] = 1.0;
+        for (int i = 1; i <= p; ++i) {
+            px[i] = px[i - 1] * x;
+            py[i] = py[i - 1] * y;
+            pz[i] = pz[i - 1] * z;
+        }
+        for (int t = 0; t < nterms; ++t) out[t] = px[ex[t]] * py[ey[t]] * pz[ez[t]];
+    }
+
+    void taylorCoefficients(double x, double y, double z, double eps2, double* b) const {
+        double r2 = x*x + y*y + z*z + eps2;
+        double invR2 = 1.0 / r2;
+        double R[3] = {x, y, z};
+        b[0] = std::sqrt(invR2);
+        for (int t = 1; t < nterms; ++t) {
+            int n = ex[t] + ey[t] + ez[t];
+            double s1 = 0.0, s2 = 0.0;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (minus1[axis][t] >= 0) s1 += R[axis] * b[minus1[axis][t]];
+                if (minus2[axis][t] >= 0) s2 += b[minus2[axis][t]];
+            }
+            b[t] = ((2 * n - 1) * s1 - (n - 1) * s2) * invR2 / (double)n;
+        }
+    }
+
+    // stable counting sort of (target, source) pairs into per-target lists
+    void groupByTarget(const std::vector<std::pair<uint32_t, uint32_t>>& pairs,
+                       std::vector<uint32_t>& offsets, std::vector<uint32_t>& sources) {
+        offsets.assign(tree.nodes.size() + 1, 0);
+        for (const auto& pair : pairs) ++offsets[pair.first + 1];
+        for (size_t n = 0; n < tree.nodes.size(); ++n) offsets[n + 1] += offsets[n];
+
+        sources.resize(pairs.size());
+        fillCursor.assign(offsets.begin(), offsets.end() - 1);
+        for (const auto& pair : pairs) sources[fillCursor[pair.first]++] = pair.second;
+    }
+
+    void upwardPass(ThreadPool* pool) {
+        for (size_t n = 0; n < tree.nodes.size(); ++n) {
+            const OctreeNode& node = tree.nodes[n];
+            centers[n * 3 + 0] = node.comX;
+            centers[n * 3 + 1] = node.comY;
+            centers[n * 3 + 2] = node.comZ;
+        }
+
+        // P2M touches only the leaf's own bodies
+        forEachTile(pool, leaves.size(), kCellTile, [&](size_t begin, size_t end) {
+            double pw[kMaxFmmTerms];
+            for (size_t l = begin; l < end; ++l) {
+                uint32_t n = leaves[l];
+                const OctreeNode& node = tree.nodes[n];
+                double cx = centers[n * 3 + 0], cy = centers[n * 3 + 1], cz = centers[n * 3 + 2];
+                double* M = &multipoles[(size_t)n * nterms];
+                double radius = 0.0;
+                for (uint32_t k = node.bodyBegin; k < node.bodyEnd; ++k) {
+                    double dx = tree.sx[k] - cx, dy = tree.sy[k] - cy, dz = tree.sz[k] - cz;
+                    radius = std::max(radius, std::sqrt(dx*dx + dy*dy + dz*dz));
+                    monomials(dx, dy, dz, pw);
+                    for (int t = 0; t < nterms; ++t) M[t] += tree.sm[k] * pw[t];
+                }
+                radii[n] = radius;
+            }
+        });
+
+        // M2M in reverse preorder so children are complete before parents
+        double pw[kMaxFmmTerms];
+        for (size_t n = tree.nodes.size(); n-- > 0;) {
+            const OctreeNode& node = tree.nodes[n];
+            if (node.leaf) continue;
+            double cx = centers[n * 3 + 0], cy = centers[n * 3 + 1], cz = centers[n * 3 + 2];
+            double* M = &multipoles[n * nterms];
+
+            double radius = 0.0;
+            for (uint32_t c = (uint32_t)n + 1; c < node.next; c = tree.nodes[c].next) {
+                double dx = centers[c * 3 + 0] - cx;
+                double dy = centers[c * 3 + 1] - cy;
+                double dz = centers[c * 3 + 2] - cz;
+                radius = std::max(radius, std::sqrt(dx*dx + dy*dy + dz*dz) + radii[c]);
+                monomials(dx, dy, dz, pw);
+                m2mPlan.apply(&multipoles[c * nterms], pw, M);
+            }
+            radii[n] = radius;
+        }
+    }
+
+    void interact(uint32_t a, uint32_t b, float theta) {
+        double dx = centers[a * 3 + 0] - centers[b * 3 + 0];
+        double dy = centers[a * 3 + 1] - centers[b * 3 + 1];
+        double dz = centers[a * 3 + 2] - centers[b * 3 + 2];
+        double r = std::sqrt(dx*dx + dy*dy + dz*dz);
+
+        if (radii[a] + radii[b] < theta * r) {
+            m2lPairs.push_back({a, b});
+            return;
+        }
+
+        const OctreeNode& A = tree.nodes[a];
+        const OctreeNode& B = tree.nodes[b];
+        if (A.leaf && B.leaf) {
+            p2pPairs.push_back({a, b});
+        } else if (B.leaf || (!A.leaf && radii[a] >= radii[b])) {
+            for (uint32_t c = a + 1; c < A.next; c = tree.nodes[c].next) interact(c, b, theta);
+        } else {
+            for (uint32_t c = b + 1; c < B.next; c = tree.nodes[c].next) interact(a, c, theta);
+        }
+    }
+
+    void m2l(uint32_t target, uint32_t source, float softening) {
+        double coeffs[kMaxFmmTerms];
+        taylorCoefficients(centers[target * 3 + 0] - centers[source * 3 + 0],
+                           centers[target * 3 + 1] - centers[source * 3 + 1],
+                           centers[target * 3 + 2] - centers[source * 3 + 2],
+                           (double)softening * softening, coeffs);
+        m2lPlan.apply(&multipoles[source * nterms], coeffs, &locals[target * nterms]);
+    }
+
+    void p2p(uint32_t target, uint32_t source, float softening) {
+        const OctreeNode& A = tree.nodes[target];
+        const OctreeNode& B = tree.nodes[source];
+        const double eps2 = (double)softening * softening;
+
+        for (uint32_t i = A.bodyBegin; i < A.bodyEnd; ++i) {
+            double xi = tree.sx[i], yi = tree.sy[i], zi = tree.sz[i];
+            double axi = 0.0, ayi = 0.0, azi = 0.0;
+            for (uint32_t j = B.bodyBegin; j < B.bodyEnd; ++j) {
+                double dx = tree.sx[j] - xi, dy = tree.sy[j] - yi, dz = tree.sz[j] - zi;
+                double r2 = dx*dx + dy*dy + dz*dz + eps2;
+                if (r2 <= 0.0) continue;
+                double invR = 1.0 / std::sqrt(r2);
+                double s = tree.sm[j] * invR * invR * invR;
+                axi += dx * s; ayi += dy * s; azi += dz * s;
+            }
+            accX[i] += axi; accY[i] += ayi; accZ[i] += azi;
+        }
+    }
+
+    void downwardPass(ThreadPool* pool) {
+        // L2L in preorder so parents are complete before children
+        double pw[kMaxFmmTerms];
+        for (size_t n = 0; n < tree.nodes.size(); ++n) {
+            const OctreeNode& node = tree.nodes[n];
+            if (node.leaf) continue;
+            const double* L = &locals[n * nterms];
+            double cx = centers[n * 3 + 0], cy = centers[n * 3 + 1], cz = centers[n * 3 + 2];
+            for (uint32_t c = (uint32_t)n + 1; c < node.next; c = tree.nodes[c].next) {
+                monomials(centers[c * 3 + 0] - cx, centers[c * 3 + 1] - cy, centers[c * 3 + 2] - cz, pw);
+                l2lPlan.apply(L, pw, &locals[c * nterms]);
+            }
+        }
+
+        // L2P: gradient of sum_l L_l h^l at each body
+        forEachTile(pool, leaves.size(), kCellTile, [&](size_t begin, size_t end) {
+            double pw[kMaxFmmTerms];
+            for (size_t l = begin; l < end; ++l) {
+                uint32_t n = leaves[l];
+                const OctreeNode& node = tree.nodes[n];
+                const double* L = &locals[(size_t)n * nterms];
+                double cx = centers[n * 3 + 0], cy = centers[n * 3 + 1], cz = centers[n * 3 + 2];
+                for (uint32_t k = node.bodyBegin; k < node.bodyEnd; ++k) {
+                    monomials(tree.sx[k] - cx, tree.sy[k] - cy, tree.sz[k] - cz, pw);
+                    double gx = 0.0, gy = 0.0, gz = 0.0;
+                    for (int t = 1; t < nterms; ++t) {
+                        if (ex[t] > 0) gx += ex[t] * L[t] * pw[minus1[0][t]];
+                        if (ey[t] > 0) gy += ey[t] * L[t] * pw[minus1[1][t]];
+                        if (ez[t] > 0) gz += ez[t] * L[t] * pw[minus1[2][t]];
+                    }
+                    accX[k] += gx; accY[k] += gy; accZ[k] += gz;
+                }
+            }
+        });
+    }
+};
@@ -0,0 +1,387 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "simd.h"
+#include "threadpool.h"
+
+// Mutual gravity over structure-of-arrays bodies. Every solver fills
+//   a_i = G * sum_j m_j * (x_j - x_i) / (|x_j - x_i|^2 + eps^2)^(3/2)
+// into the ax/ay/az arrays of a GravitySystem. When `targets` is set only
+// those bodies get new accelerations; every body still acts as a source.
+
+struct GravitySystem {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* mass;
+    float* ax;
+    float* ay;
+    float* az;
+    size_t count;
+    const uint32_t* targets;    // optional subset to evaluate, nullptr for all
+    size_t targetCount;
+
+    size_t targetTotal() const { return targets ? targetCount : count; }
+    size_t target(size_t k) const { return targets ? targets[k] : k; }
+};
+
+struct GravityParams {
+    float G;
+    float softening;
+    float theta;        // Barnes-Hut opening angle, smaller is more accurate
+};
+
+// Largest opening angle the tree accepts. A cell holding the point is at
+// most sqrt(3) half-widths from it, so below 2 / sqrt(3) it always opens.
+static const float kMaxTheta = 1.0f;
+
+// targets are split into tiles and each target is summed by exactly one
+// tile in a fixed source order, so results do not depend on thread count
+static const size_t kDirectTargetTile = 64;
+static const size_t kTreeTargetTile = 256;
+
+
+// Direct summation over targets [begin, end) against every source, in
+// source index order. The vector kernels put 8 or 16 sources in the lanes
+// and refine rsqrt with one Newton step, y' = y * (1.5 - 0.5 * r2 * y^2),
+// which takes the 12/14-bit estimate to near full float precision.
+static inline void directSumScalar(const GravitySystem& sys, const GravityParams& params, size_t begin, size_t end) {
+    const float eps2 = params.softening * params.softening;
+
+    for (size_t k = begin; k < end; ++k) {
+        const size_t i = sys.target(k);
+        float xi = sys.x[i], yi = sys.y[i], zi = sys.z[i];
+        float axi = 0.0f, ayi = 0.0f, azi = 0.0f;
+
+        for (size_t j = 0; j < sys.count; ++j) {
+            float dx = sys.x[j] - xi;
+            float dy = sys.y[j] - yi;
+            float dz = sys.z[j] - zi;
+            float r2 = dx*dx + dy*dy + dz*dz + eps2;
+            if (r2 <= 0.0f) continue;
+
+            float invR = 1.0f / std::sqrt(r2);
+            float s = sys.mass[j] * invR * invR * invR;
+            axi += dx * s;
+            ayi += dy * s;
+            azi += dz * s;
+        }
+
+        sys.ax[i] = params.G * axi;
+        sys.ay[i] = params.G * ayi;
+        sys.az[i] = params.G * azi;
+    }
+}
+
+#if GRAVITY_SIMD_X86
+SIMD_TARGET_AVX2 static inline float horizontalSum(__m256 v) {
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+    return _mm_cvtss_f32(lo);
+}
+
+SIMD_TARGET_AVX2 static void directSumAvx2(const GravitySystem& sys, const GravityParams& params, size_t begin, size_t end) {
+    const __m256 eps2 = _mm256_set1_ps(params.softening * params.softening);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const size_t n = sys.count;
+    const size_t full = n & ~(size_t)7;
+
+    alignas(32) int tailMask[8];
+    for (int l = 0; l < 8; ++l) tailMask[l] = (full + l < n) ? -1 : 0;
+    const __m256i mask = _mm256_load_si256((const __m256i*)tailMask);
+
+    for (size_t k = begin; k < end; ++k) {
+        const size_t i = sys.target(k);
+        const __m256 xi = _mm256_set1_ps(sys.x[i]);
+        const __m256 yi = _mm256_set1_ps(sys.y[i]);
+        const __m256 zi = _mm256_set1_ps(sys.z[i]);
+        __m256 ax = zero, ay = zero, az = zero;
+
+        for (size_t j = 0; j < n; j += 8) {
+            __m256 xj, yj, zj, mj;
+            if (j < full) {
+                xj = _mm256_loadu_ps(sys.x + j);
+                yj = _mm256_loadu_ps(sys.y + j);
+                zj = _mm256_loadu_ps(sys.z + j);
+                mj = _mm256_loadu_ps(sys.mass + j);
+            } else {
+                xj = _mm256_maskload_ps(sys.x + j, mask);
+                yj = _mm256_maskload_ps(sys.y + j, mask);
+                zj = _mm256_maskload_ps(sys.z + j, mask);
+                mj = _mm256_maskload_ps(sys.mass + j, mask);
+            }
+
+            __m256 dx = _mm256_sub_ps(xj, xi);
+            __m256 dy = _mm256_sub_ps(yj, yi);
+            __m256 dz = _mm256_sub_ps(zj, zi);
+            __m256 r2 = _mm256_fmadd_ps(dx, dx, eps2);
+            r2 = _mm256_fmadd_ps(dy, dy, r2);
+            r2 = _mm256_fmadd_ps(dz, dz, r2);
+
+            __m256 inv = _mm256_rsqrt_ps(r2);
+            __m256 hr2 = _mm256_mul_ps(half, r2);
+            inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(hr2, _mm256_mul_ps(inv, inv), threeHalves));
+            inv = _mm256_and_ps(inv, _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+
+            __m256 s = _mm256_mul_ps(mj, _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+            ax = _mm256_fmadd_ps(dx, s, ax);
+            ay = _mm256_fmadd_ps(dy, s, ay);
+            az = _mm256_fmadd_ps(dz, s, az);
+        }
+
+        sys.ax[i] = params.G * horizontalSum(ax);
+        sys.ay[i] = params.G * horizontalSum(ay);
+        sys.az[i] = params.G * horizontalSum(az);
+    }
+}
+
+SIMD_TARGET_AVX512 static void directSumAvx512(const GravitySystem& sys, const GravityParams& params, size_t begin, size_t end) {
+    const __m512 eps2 = _mm512_set1_ps(params.softening * params.softening);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 threeHalves = _mm512_set1_ps(1.5f);
+    const __m512 zero = _mm512_setzero_ps();
+    const size_t n = sys.count;
+
+    for (size_t k = begin; k < end; ++k) {
+        const size_t i = sys.target(k);
+        const __m512 xi = _mm512_set1_ps(sys.x[i]);
+        const __m512 yi = _mm512_set1_ps(sys.y[i]);
+        const __m512 zi = _mm512_set1_ps(sys.z[i]);
+        __m512 ax = zero, ay = zero, az = zero;
+
+        for (size_t j = 0; j < n; j += 16) {
+            __mmask16 lanes = (n - j >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (n - j)) - 1u);
+            __m512 xj = _mm512_maskz_loadu_ps(lanes, sys.x + j);
+            __m512 yj = _mm512_maskz_loadu_ps(lanes, sys.y + j);
+            __m512 zj = _mm512_maskz_loadu_ps(lanes, sys.z + j);
+            __m512 mj = _mm512_maskz_loadu_ps(lanes, sys.mass + j);
+
+            __m512 dx = _mm512_sub_ps(xj, xi);
+            __m512 dy = _mm512_sub_ps(yj, yi);
+            __m512 dz = _mm512_sub_ps(zj, zi);
+            __m512 r2 = _mm512_fmadd_ps(dx, dx, eps2);
+            r2 = _mm512_fmadd_ps(dy, dy, r2);
+            r2 = _mm512_fmadd_ps(dz, dz, r2);
+
+            __mmask16 valid = _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+            __m512 inv = _mm512_maskz_rsqrt14_ps(valid, r2);
+            __m512 hr2 = _mm512_mul_ps(half, r2);
+            inv = _mm512_mul_ps(inv, _mm512_fnmadd_ps(hr2, _mm512_mul_ps(inv, inv), threeHalves));
+
+            __m512 s = _mm512_mul_ps(mj, _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+            ax = _mm512_fmadd_ps(dx, s, ax);
+            ay = _mm512_fmadd_ps(dy, s, ay);
+            az = _mm512_fmadd_ps(dz, s, az);
+        }
+
+        sys.ax[i] = params.G * _mm512_reduce_add_ps(ax);
+        sys.ay[i] = params.G * _mm512_reduce_add_ps(ay);
+        sys.az[i] = params.G * _mm512_reduce_add_ps(az);
+    }
+}
+#endif
+
+// targets [begin, end) of sys.target() on the widest kernel this CPU supports
+static inline void directSumRange(const GravitySystem& sys, const GravityParams& params, size_t begin, size_t end) {
+#if GRAVITY_SIMD_X86
+    switch (simdLevel()) {
+        case SIMD_AVX512: directSumAvx512(sys, params, begin, end); return;
+        case SIMD_AVX2:   directSumAvx2(sys, params, begin, end); return;
+        default: break;
+    }
+#endif
+    directSumScalar(sys, params, begin, end);
+}
+
+// O(n^2), the fastest choice up to a few tens of thousands of bodies
+static inline void computeGravityDirect(const GravitySystem& sys, const GravityParams& params, ThreadPool* pool = nullptr) {
+    forEachTile(pool, sys.targetTotal(), kDirectTargetTile, [&](size_t begin, size_t end) {
+        directSumRange(sys, params, begin, end);
+    });
+}
+
+// Nodes are stored in depth-first preorder, so a node's first child is the
+// next node and `next` skips the whole subtree. Traversal needs no stack.
+struct OctreeNode {
+    float comX, comY, comZ, mass;     // monopole
+    float cx, cy, cz, halfSize;       // cell cube
+    float comOffset;                  // distance from cell center to com
+    uint32_t next;
+    uint32_t bodyBegin, bodyEnd;      // range into Octree::order
+    bool leaf;
+};
+
+class Octree {
+public:
+    std::vector<OctreeNode> nodes;
+    std::vector<uint32_t> order;      // body indices grouped by leaf
+
+    // bodies copied into tree order so leaf loops stream contiguous memory
+    std::vector<float> sx, sy, sz, sm;
+
+    void build(const float* x, const float* y, const float* z, const float* mass, size_t count,
+               uint32_t leafSize = 8) {
+        maxLeafSize = std::max<uint32_t>(leafSize, 1);
+        nodes.clear();
+        order.resize(count);
+        for (size_t i = 0; i < count; ++i) order[i] = (uint32_t)i;
+        if (count == 0) return;
+
+        float minX = x[0], maxX = x[0];
+        float minY = y[0], maxY = y[0];
+        float minZ = z[0], maxZ = z[0];
+        for (size_t i = 1; i < count; ++i) {
+            minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+            minY = std::min(minY, y[i]); maxY = std::max(maxY, y[i]);
+            minZ = std::min(minZ, z[i]); maxZ = std::max(maxZ, z[i]);
+        }
+        float half = 0.5f * std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
+        half = half * 1.001f + 1e-3f;
+
+        xs = x; ys = y; zs = z; ms = mass;
+        buildNode(0, (uint32_t)count, 0.5f * (minX + maxX), 0.5f * (minY + maxY), 0.5f * (minZ + maxZ), half, 0);
+
+        sx.resize(count); sy.resize(count); sz.resize(count); sm.resize(count);
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t i = order[k];
+            sx[k] = x[i]; sy[k] = y[i]; sz[k] = z[i]; sm[k] = mass[i];
+        }
+    }
+
+    // acceleration on a point from every body, opening cells that fail
+    // d > size / theta + comOffset, theta clamped to (0, kMaxTheta]
+    void accelerationAt(float px, float py, float pz, const GravityParams& params,
+                        float& outX, float& outY, float& outZ) const {
+        const float eps2 = params.softening * params.softening;
+        const float invTheta = 1.0f / std::min(std::max(params.theta, 1e-3f), kMaxTheta);
+        float axi = 0.0f, ayi = 0.0f, azi = 0.0f;
+
+        uint32_t i = 0;
+        const uint32_t end = (uint32_t)nodes.size();
+        while (i < end) {
+            const OctreeNode& node = nodes[i];
+            float dx = node.comX - px;
+            float dy = node.comY - py;
+            float dz = node.comZ - pz;
+            float d2 = dx*dx + dy*dy + dz*dz;
+            float openRadius = 2.0f * node.halfSize * invTheta + node.comOffset;
+
+            if (d2 > openRadius * openRadius) {
+                float invR = 1.0f / std::sqrt(d2 + eps2);
+                float s = node.mass * invR * invR * invR;
+                axi += dx * s; ayi += dy * s; azi += dz * s;
+                i = node.next;
+            } else if (node.leaf) {
+                for (uint32_t k = node.bodyBegin; k < node.bodyEnd; ++k) {
+                    float bx = sx[k] - px;
+                    float by = sy[k] - py;
+                    float bz = sz[k] - pz;
+                    float r2 = bx*bx + by*by + bz*bz + eps2;
+                    if (r2 <= 0.0f) continue;
+                    float invR = 1.0f / std::sqrt(r2);
+                    float s = sm[k] * invR * invR * invR;
+                    axi += bx * s; ayi += by * s; azi += bz * s;
+                }
+                i = node.next;
+            } else {
+                i = i + 1;
+            }
+        }
+
+        outX = params.G * axi;
+        outY = params.G * ayi;
+        outZ = params.G * azi;
+    }
+
+private:
+    static const int kMaxDepth = 32;
+
+    uint32_t maxLeafSize = 8;
+
+    const float* xs = nullptr;
+    const float* ys = nullptr;
+    const float* zs = nullptr;
+    const float* ms = nullptr;
+
+    void buildNode(uint32_t begin, uint32_t end, float cx, float cy, float cz, float half, int depth) {
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.push_back(OctreeNode());
+
+        double m = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+        for (uint32_t k = begin; k < end; ++k) {
+            uint32_t b = order[k];
+            m += ms[b];
+            mx += (double)ms[b] * xs[b];
+            my += (double)ms[b] * ys[b];
+            mz += (double)ms[b] * zs[b];
+        }
+
+        OctreeNode node;
+        node.mass = (float)m;
+        if (m > 0.0) {
+            node.comX = (float)(mx / m); node.comY = (float)(my / m); node.comZ = (float)(mz / m);
+        } else {
+            node.comX = cx; node.comY = cy; node.comZ = cz;
+        }
+        node.cx = cx; node.cy = cy; node.cz = cz;
+        node.halfSize = half;
+        float ox = node.comX - cx, oy = node.comY - cy, oz = node.comZ - cz;
+        node.comOffset = std::sqrt(ox*ox + oy*oy + oz*oz);
+        node.bodyBegin = begin;
+        node.bodyEnd = end;
+        node.leaf = (end - begin <= maxLeafSize) || depth >= kMaxDepth;
+
+        if (!node.leaf) {
+            // split the range into octants: x, then y within each half, then z
+            uint32_t* first = order.data() + begin;
+            uint32_t* last = order.data() + end;
+            uint32_t* splitX = std::partition(first, last, [&](uint32_t b) { return xs[b] < cx; });
+            uint32_t* halves[3] = {first, splitX, last};
+            uint32_t* bounds[9];
+            for (int hx = 0; hx < 2; ++hx) {
+                uint32_t* splitY = std::partition(halves[hx], halves[hx + 1], [&](uint32_t b) { return ys[b] < cy; });
+                uint32_t* quarters[3] = {halves[hx], splitY, halves[hx + 1]};
+                for (int hy = 0; hy < 2; ++hy) {
+                    uint32_t* splitZ = std::partition(quarters[hy], quarters[hy + 1], [&](uint32_t b) { return zs[b] < cz; });
+                    bounds[hx * 4 + hy * 2] = quarters[hy];
+                    bounds[hx * 4 + hy * 2 + 1] = splitZ;
+                }
+            }
+            bounds[8] = last;
+
+            float q = 0.5f * half;
+            for (int oct = 0; oct < 8; ++oct) {
+                uint32_t childBegin = (uint32_t)(bounds[oct] - order.data());
+                uint32_t childEnd = (uint32_t)(bounds[oct + 1] - order.data());
+                if (childBegin == childEnd) continue;
+                float ccx = cx + ((oct & 4) ? q : -q);
+                float ccy = cy + ((oct & 2) ? q : -q);
+                float ccz = cz + ((oct & 1) ? q : -q);
+                buildNode(childBegin, childEnd, ccx, ccy, ccz, q, depth + 1);
+            }
+        }
+
+        node.next = (uint32_t)nodes.size();
+        nodes[index] = node;
+    }
+};
+
+// O(n log n) tree code, accuracy controlled by params.theta
+static inline void computeGravityBarnesHut(const GravitySystem& sys, const GravityParams& params, Octree& tree,
+                                           ThreadPool* pool = nullptr) {
+    tree.build(sys.x, sys.y, sys.z, sys.mass, sys.count);
+
+    // full passes follow tree order so neighbouring targets share traversal paths
+    forEachTile(pool, sys.targetTotal(), kTreeTargetTile, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            size_t i = sys.targets ? sys.targets[k] : tree.order[k];
+            tree.accelerationAt(sys.x[i], sys.y[i], sys.z[i], params, sys.ax[i], sys.ay[i], sys.az[i]);
+        }
+    });
+}
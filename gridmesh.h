@@ -0,0 +1,294 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "shader.h"
+
+// The spacetime grid as one GL_LINES draw. The plane positions and the
+// index buffer that stitches rows and columns together are built once; each
+// frame streams a single float per point, the smoothed curvature, into an
+// orphaned buffer. The vertex shader turns it into the bent height and the
+// depth colour ramp, so a 121 x 121 grid costs one upload and one draw
+// instead of some 30k immediate mode calls.
+//
+// Orphaning (glBufferData with no data, then glBufferSubData) lets the
+// driver hand out fresh storage while the GPU may still read last frame's,
+// and unlike persistent mapping it needs nothing beyond GL 2.1, so it runs
+// on Mesa llvmpipe and on the macOS legacy context alike.
+//
+// drawField() skips the CPU field altogether: body positions, masses and
+// radii go up as uniform arrays and the vertex shader sums the same terms
+// as CurvatureField, tiers, spike and bowl included, for every grid point.
+// Nothing is streamed then, so the cost is points x bodies on the GPU and
+// large grids stay cheap for the CPU. That path draws the raw field; the
+// CPU path's neighbour smoothing needs the values of adjacent points.
+
+class GridMesh {
+public:
+    GridMesh() = default;
+    GridMesh(const GridMesh&) = delete;
+    GridMesh& operator=(const GridMesh&) = delete;
+
+    // uniform arrays stay well inside the 1024 vertex uniform components GL 3.0 guarantees
+    static const int kMaxFieldBodies = 64;
+
+    bool ready() const { return program != 0; }
+
+    // (Re)builds the static buffers for an nx x ny grid; point (i, j) sits at
+    // (originX + i spacing, originY + j spacing) and reads curvature[i * ny + j].
+    bool init(int nx, int ny, float originX, float originY, float spacing) {
+        if (ready() && nx == pointsX && ny == pointsY && originX == planeX && originY == planeY && spacing == step) {
+            return true;
+        }
+        release();
+        if (!program && !(program = buildProgram("spacetime grid", kVertexShader, kFragmentShader, {"planeXY", "curvature"}))) {
+            return false;
+        }
+        pointsX = nx; pointsY = ny;
+        planeX = originX; planeY = originY; step = spacing;
+
+        std::vector<float> plane((size_t)nx * ny * 2);
+        for (int i = 0; i < nx; ++i) {
+            for (int j = 0; j < ny; ++j) {
+                plane[((size_t)i * ny + j) * 2 + 0] = originX + i * spacing;
+                plane[((size_t)i * ny + j) * 2 + 1] = originY + j * spacing;
+            }
+        }
+
+        // one segment between every pair of neighbours along j (the rows of
+        // the old strips) and along i (the columns)
+        std::vector<uint32_t> indices;
+        indices.reserve((size_t)4 * nx * ny);
+        for (int i = 0; i < nx; ++i) {
+            for (int j = 0; j + 1 < ny; ++j) {
+                indices.push_back((uint32_t)(i * ny + j));
+                indices.push_back((uint32_t)(i * ny + j + 1));
+            }
+        }
+        for (int j = 0; j < ny; ++j) {
+            for (int i = 0; i + 1 < nx; ++i) {
+                indices.push_back((uint32_t)(i * ny + j));
+                indices.push_back((uint32_t)((i + 1) * ny + j));
+            }
+        }
+        indexCount = (GLsizei)indices.size();
+
+        glGenBuffers(1, &planeBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, planeBuffer);
+        glBufferData(GL_ARRAY_BUFFER, plane.size() * sizeof(float), plane.data(), GL_STATIC_DRAW);
+
+        glGenBuffers(1, &curvatureBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, curvatureBuffer);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)nx * ny * sizeof(float), nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glGenBuffers(1, &indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        uBaseZ = glGetUniformLocation(program, "baseZ");
+        uBendScale = glGetUniformLocation(program, "bendScale");
+        uMaxBend = glGetUniformLocation(program, "maxBend");
+        uPulse = glGetUniformLocation(program, "pulse");
+        return true;
+    }
+
+    // replaces all nx * ny curvature values
+    void upload(const float* curvature) {
+        const GLsizeiptr bytes = (GLsizeiptr)pointsX * pointsY * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, curvatureBuffer);
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, curvature);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // height = baseZ - min(curvature * bendScale, maxBend)
+    void draw(float baseZ, float bendScale, float maxBend, float pulse) const {
+        if (!ready()) return;
+        glUseProgram(program);
+        glUniform1f(uBaseZ, baseZ);
+        glUniform1f(uBendScale, bendScale);
+        glUniform1f(uMaxBend, maxBend);
+        glUniform1f(uPulse, pulse);
+
+        glBindBuffer(GL_ARRAY_BUFFER, planeBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glBindBuffer(GL_ARRAY_BUFFER, curvatureBuffer);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glDrawElements(GL_LINES, indexCount, GL_UNSIGNED_INT, nullptr);
+
+        glDisableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+    }
+
+    // must run while the context is still current
+    void release() {
+        if (planeBuffer) glDeleteBuffers(1, &planeBuffer);
+        if (curvatureBuffer) glDeleteBuffers(1, &curvatureBuffer);
+        if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+        planeBuffer = curvatureBuffer = indexBuffer = 0;
+        pointsX = pointsY = 0;
+    }
+
+    void destroy() {
+        release();
+        if (program) glDeleteProgram(program);
+        if (fieldProgram) glDeleteProgram(fieldProgram);
+        program = fieldProgram = 0;
+    }
+
+    // whether drawField() can take bodyCount bodies, as far as is known
+    // before its program is built; touches no GL, so workers may ask
+    bool canDrawField(size_t bodyCount) const {
+        return !fieldProgramFailed && bodyCount <= (size_t)kMaxFieldBodies;
+    }
+
+    // Evaluates the curvature of up to kMaxFieldBodies bodies per vertex and
+    // draws the bent grid. Returns false, drawing nothing, when the bodies do
+    // not fit or the program failed to build, so callers can fall back.
+    template <typename Store>
+    bool drawField(const Store& bodies, float baseZ, float bendScale, float maxBend, float pulse) {
+        const size_t n = bodies.size();
+        if (!ready() || n > (size_t)kMaxFieldBodies) return false;
+        if (!fieldProgram) {
+            if (fieldProgramFailed) return false;
+            fieldProgram = buildProgram("spacetime field", kFieldVertexShader, kFragmentShader, {"planeXY"});
+            if (!fieldProgram) {
+                fieldProgramFailed = true;
+                return false;
+            }
+            fBaseZ = glGetUniformLocation(fieldProgram, "baseZ");
+            fBendScale = glGetUniformLocation(fieldProgram, "bendScale");
+            fMaxBend = glGetUniformLocation(fieldProgram, "maxBend");
+            fPulse = glGetUniformLocation(fieldProgram, "pulse");
+            fBodyCount = glGetUniformLocation(fieldProgram, "bodyCount");
+            fBodyPosMass = glGetUniformLocation(fieldProgram, "bodyPosMass");
+            fBodyRadius = glGetUniformLocation(fieldProgram, "bodyRadius");
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            posMass[i * 4 + 0] = bodies.x[i];
+            posMass[i * 4 + 1] = bodies.y[i];
+            posMass[i * 4 + 2] = bodies.z[i];
+            posMass[i * 4 + 3] = bodies.mass[i];
+            radius[i] = bodies.radius[i];
+        }
+
+        glUseProgram(fieldProgram);
+        glUniform1f(fBaseZ, baseZ);
+        glUniform1f(fBendScale, bendScale);
+        glUniform1f(fMaxBend, maxBend);
+        glUniform1f(fPulse, pulse);
+        glUniform1i(fBodyCount, (GLint)n);
+        if (n > 0) {
+            glUniform4fv(fBodyPosMass, (GLsizei)n, posMass);
+            glUniform1fv(fBodyRadius, (GLsizei)n, radius);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, planeBuffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glDrawElements(GL_LINES, indexCount, GL_UNSIGNED_INT, nullptr);
+
+        glDisableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+        return true;
+    }
+
+private:
+    // depth colour ramp shared by both vertex shaders
+#define GRIDMESH_GLSL_HEADER \
+        "#version 120\n" \
+        "vec4 depthColor(float depth, float maxBend, float pulse) {\n" \
+        "    float t = clamp(depth / maxBend, 0.0, 1.0);\n" \
+        "    vec3 rgb;\n" \
+        "    if (t < 0.3) rgb = vec3(0.2 + t / 0.3 * 0.4);\n" \
+        "    else if (t < 0.7) rgb = vec3(0.6 + (t - 0.3) / 0.4 * 0.4);\n" \
+        "    else rgb = vec3(1.0 - (t - 0.7) / 0.3 * 0.2, 1.0 - (t - 0.7) / 0.3 * 0.1, 1.0);\n" \
+        "    return vec4(rgb, 0.7 + t * 0.3) * pulse;\n" \
+        "}\n"
+
+    static constexpr const char* kVertexShader = GRIDMESH_GLSL_HEADER R"(
+        attribute vec2 planeXY;
+        attribute float curvature;
+        uniform float baseZ, bendScale, maxBend, pulse;
+        varying vec4 color;
+
+        void main() {
+            float depth = min(curvature * bendScale, maxBend);
+            color = depthColor(depth, maxBend, pulse);
+            gl_Position = gl_ModelViewProjectionMatrix * vec4(planeXY, baseZ - depth, 1.0);
+        }
+    )";
+
+    // the terms of CurvatureField::contribution with the tiers of update()
+    static constexpr const char* kFieldVertexShader = GRIDMESH_GLSL_HEADER R"(
+        const int kMaxBodies = 64;
+        attribute vec2 planeXY;
+        uniform float baseZ, bendScale, maxBend, pulse;
+        uniform int bodyCount;
+        uniform vec4 bodyPosMass[kMaxBodies];
+        uniform float bodyRadius[kMaxBodies];
+        varying vec4 color;
+
+        void main() {
+            vec3 p = vec3(planeXY, baseZ);
+            float total = 0.0;
+            for (int b = 0; b < kMaxBodies; ++b) {
+                if (b >= bodyCount) break;
+                float mass = bodyPosMass[b].w, radius = bodyRadius[b];
+                bool star = mass > 500.0;
+                float R, base, local;
+                if (star)               { R = 160.0; base = 20.0; local = 12.0; }
+                else if (radius > 22.0) { R = 95.0;  base = 65.0; local = 50.0; }
+                else if (radius > 15.0) { R = 75.0;  base = 60.0; local = 45.0; }
+                else                    { R = 55.0;  base = 55.0; local = 40.0; }
+
+                float d = max(length(p - bodyPosMass[b].xyz), 1e-6);
+                if (d > R) continue;
+                float l = max(0.0, 1.0 - 2.0 * d / R);
+                float broad = 1.0 - d / R;
+                float influence = local * l * l + mass * base * broad * broad * broad / (d * d + 3.0);
+                if (star) influence += 10.0 * exp(-d / 50.0);
+                else if (d < 25.0) influence += 30.0 * exp(-d / 8.0);
+                total += influence;
+            }
+            float depth = min(total * bendScale, maxBend);
+            color = depthColor(depth, maxBend, pulse);
+            gl_Position = gl_ModelViewProjectionMatrix * vec4(planeXY, baseZ - depth, 1.0);
+        }
+    )";
+#undef GRIDMESH_GLSL_HEADER
+
+    static constexpr const char* kFragmentShader = R"(
+        #version 120
+        varying vec4 color;
+        void main() { gl_FragColor = color; }
+    )";
+
+    GLuint program = 0;
+    GLuint planeBuffer = 0, curvatureBuffer = 0, indexBuffer = 0;
+    GLsizei indexCount = 0;
+    GLint uBaseZ = -1, uBendScale = -1, uMaxBend = -1, uPulse = -1;
+
+    GLuint fieldProgram = 0;
+    bool fieldProgramFailed = false;
+    GLint fBaseZ = -1, fBendScale = -1, fMaxBend = -1, fPulse = -1;
+    GLint fBodyCount = -1, fBodyPosMass = -1, fBodyRadius = -1;
+    float posMass[kMaxFieldBodies * 4];
+    float radius[kMaxFieldBodies];
+    int pointsX = 0, pointsY = 0;
+    float planeX = 0.0f, planeY = 0.0f, step = 0.0f;
+};
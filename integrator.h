@@ -0,0 +1,68 @@
+#pragma once
+
+// Time integrators for the mutual-gravity backends.
+//
+// The higher order schemes are compositions of kick-drift-kick leapfrog
+// stages with weights w_i that sum to one (Yoshida 1990). The three stage
+// triple jump is the 4th order Forest-Ruth integrator; the seven stage
+// "solution A" is 6th order. All of them are symplectic, so the energy error
+// oscillates around a bounded value instead of drifting, and the higher
+// orders reach a given error with much longer steps.
+
+enum Integrator {
+    SEMI_IMPLICIT_EULER,  // 1st order, one force pass per step
+    LEAPFROG,             // 2nd order kick-drift-kick, one force pass per step
+    BLOCK_LEAPFROG,       // leapfrog with per-body power-of-two steps, see blocksteps.h
+    FOREST_RUTH,          // 4th order, three force passes per step
+    YOSHIDA6,             // 6th order, seven force passes per step
+    INTEGRATOR_COUNT
+};
+
+struct IntegratorScheme {
+    const char* name;
+    int stages;             // leapfrog stages, 0 for Euler
+    double weights[7];
+    float stepScale;        // longest step in units of kDt
+};
+
+static inline const IntegratorScheme& integratorScheme(Integrator integrator) {
+    static const double kCbrt2 = 1.2599210498948732;
+    static const double kTripleJump = 1.0 / (2.0 - kCbrt2);
+
+    static const double w1 = -1.17767998417887;
+    static const double w2 = 0.235573213359357;
+    static const double w3 = 0.784513610477560;
+    static const double w0 = 1.0 - 2.0 * (w1 + w2 + w3);
+
+    static const IntegratorScheme schemes[INTEGRATOR_COUNT] = {
+        {"semi-implicit Euler", 0, {0}, 1.0f},
+        {"leapfrog", 1, {1.0}, 1.0f},
+        {"leapfrog (block timesteps)", 1, {1.0}, 1.0f},
+        {"Forest-Ruth (4th order)", 3, {kTripleJump, -kCbrt2 * kTripleJump, kTripleJump}, 4.0f},
+        {"Yoshida (6th order)", 7, {w3, w2, w1, w0, w1, w2, w3}, 8.0f},
+    };
+    return schemes[(integrator >= 0 && integrator < INTEGRATOR_COUNT) ? integrator : LEAPFROG];
+}
+
+// One step of `integrator` on a store with kick(dt) and drift(dt).
+// ax/ay/az must hold the accelerations at the current positions on entry
+// and hold the ones at the new positions on return, so consecutive steps
+// share a force pass. BLOCK_LEAPFROG steps as plain leapfrog here; its
+// per-body steps live in BlockTimesteps.
+template <typename Store, typename Forces>
+static inline void integrateStep(Store& bodies, Integrator integrator, float dt, const Forces& computeForces) {
+    const IntegratorScheme& scheme = integratorScheme(integrator);
+    if (scheme.stages == 0) {
+        bodies.kick(dt);
+        bodies.drift(dt);
+        computeForces();
+        return;
+    }
+    for (int s = 0; s < scheme.stages; ++s) {
+        float h = (float)(scheme.weights[s] * dt);
+        bodies.kick(0.5f * h);
+        bodies.drift(h);
+        computeForces();
+        bodies.kick(0.5f * h);
+    }
+}
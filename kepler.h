@@ -0,0 +1,163 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+#include "simd.h"
+#include "threadpool.h"
+
+// Closed-form two-body propagation. Each orbit keeps its elements, so the
+// position at time t is O(1) and exact no matter how far t jumps:
+//   mean anomaly       M = M0 + n t                     (reduced in double)
+//   eccentric anomaly  E - e sin E = M                  (Newton, fixed count)
+//   position           a (cos E - e) P + b sin E Q
+// The last line is r cos(nu) P + r sin(nu) Q written through E, so the true
+// anomaly nu never needs an atan2. P points at perihelion and Q is the
+// in-plane direction of motion there; the focus sits at the origin.
+//
+// The Newton loop runs a fixed number of iterations from Danby's starting
+// value E0 = M + 0.85 e sign(sin M), which converges for every e < 1, so
+// lanes never diverge and the loop vectorizes without masks.
+
+static const int kKeplerIterations = 6;
+static const size_t kKeplerTile = 4096;
+
+struct KeplerOrbits {
+    std::vector<double> meanAnomalyAtEpoch, meanMotion;
+    std::vector<float> semiMajor, semiMinor, eccentricity;
+    std::vector<float> px, py, pz;      // unit vector towards perihelion
+    std::vector<float> qx, qy, qz;      // unit vector along the velocity at perihelion
+    std::vector<float> meanAnomaly;     // scratch for the current propagate()
+
+    size_t size() const { return semiMajor.size(); }
+
+    void add(float a, float e, float period, float meanAnomaly0,
+             float pX, float pY, float pZ, float qX, float qY, float qZ) {
+        meanAnomalyAtEpoch.push_back(meanAnomaly0);
+        meanMotion.push_back(2.0 * M_PI / (double)period);
+        semiMajor.push_back(a);
+        semiMinor.push_back(a * std::sqrt(std::max(0.0f, 1.0f - e * e)));
+        eccentricity.push_back(e);
+        px.push_back(pX); py.push_back(pY); pz.push_back(pZ);
+        qx.push_back(qX); qy.push_back(qY); qz.push_back(qZ);
+        meanAnomaly.push_back(0.0f);
+    }
+
+    // writes the position of orbit k at time t to x[k], y[k], z[k]
+    void propagate(double t, float* x, float* y, float* z, ThreadPool* pool = nullptr) {
+        forEachTile(pool, size(), kKeplerTile, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k) {
+                double M = std::remainder(meanAnomalyAtEpoch[k] + meanMotion[k] * t, 2.0 * M_PI);
+                meanAnomaly[k] = (float)M;
+            }
+            positionsRange(begin, end, x, y, z);
+        });
+    }
+
+private:
+    // sin and cos for |v| up to a few pi: Cody-Waite reduction by pi/2 and
+    // the cephes single precision polynomials on [-pi/4, pi/4]
+    static inline void sinCos(float v, float& s, float& c) {
+        float q = std::nearbyint(v * 0.636619772f);
+        float r = v - q * 1.5703125f;
+        r -= q * 4.83751297e-4f;
+        r -= q * 7.54978995e-8f;
+        float r2 = r * r;
+        float ps = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+        float pc = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+        int quadrant = (int)q & 3;
+        float sv = (quadrant & 1) ? pc : ps;
+        float cv = (quadrant & 1) ? ps : pc;
+        s = (quadrant & 2) ? -sv : sv;
+        c = ((quadrant + 1) & 2) ? -cv : cv;
+    }
+
+    void positionScalar(size_t k, float* x, float* y, float* z) const {
+        float M = meanAnomaly[k], e = eccentricity[k];
+        // sign(sin M) is sign(M) once M is reduced to [-pi, pi]
+        float E = M + 0.85f * e * (float)((M > 0.0f) - (M < 0.0f));
+        float s, c;
+        for (int it = 0; it < kKeplerIterations; ++it) {
+            sinCos(E, s, c);
+            E -= (E - e * s - M) / (1.0f - e * c);
+        }
+        sinCos(E, s, c);
+
+        float u = semiMajor[k] * (c - e);
+        float w = semiMinor[k] * s;
+        x[k] = u * px[k] + w * qx[k];
+        y[k] = u * py[k] + w * qy[k];
+        z[k] = u * pz[k] + w * qz[k];
+    }
+
+#if GRAVITY_SIMD_X86
+    SIMD_TARGET_AVX2 static inline void sinCosAvx2(__m256 v, __m256& s, __m256& c) {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        __m256 q = _mm256_round_ps(_mm256_mul_ps(v, _mm256_set1_ps(0.636619772f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 r = _mm256_fnmadd_ps(q, _mm256_set1_ps(1.5703125f), v);
+        r = _mm256_fnmadd_ps(q, _mm256_set1_ps(4.83751297e-4f), r);
+        r = _mm256_fnmadd_ps(q, _mm256_set1_ps(7.54978995e-8f), r);
+        __m256 r2 = _mm256_mul_ps(r, r);
+
+        __m256 ps = _mm256_fmadd_ps(r2, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+        ps = _mm256_fmadd_ps(r2, ps, _mm256_set1_ps(-1.6666654611e-1f));
+        ps = _mm256_fmadd_ps(_mm256_mul_ps(r, r2), ps, r);
+
+        __m256 pc = _mm256_fmadd_ps(r2, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+        pc = _mm256_fmadd_ps(r2, pc, _mm256_set1_ps(4.166664568298827e-2f));
+        pc = _mm256_fmadd_ps(_mm256_mul_ps(r2, r2), pc, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, one));
+
+        __m256i quadrant = _mm256_cvtps_epi32(q);
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 sv = _mm256_blendv_ps(ps, pc, swap);
+        __m256 cv = _mm256_blendv_ps(pc, ps, swap);
+        __m256i signS = _mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30);
+        __m256i signC = _mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30);
+        s = _mm256_xor_ps(sv, _mm256_castsi256_ps(signS));
+        c = _mm256_xor_ps(cv, _mm256_castsi256_ps(signC));
+    }
+
+    SIMD_TARGET_AVX2 void positionsAvx2(size_t begin, size_t end, float* x, float* y, float* z) const {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 danby = _mm256_set1_ps(0.85f);
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+        size_t k = begin;
+        for (; k + 8 <= end; k += 8) {
+            __m256 M = _mm256_loadu_ps(&meanAnomaly[k]);
+            __m256 e = _mm256_loadu_ps(&eccentricity[k]);
+
+            __m256 start = _mm256_or_ps(_mm256_mul_ps(danby, e), _mm256_and_ps(M, signBit));
+            __m256 E = _mm256_add_ps(M, _mm256_and_ps(start, _mm256_cmp_ps(M, zero, _CMP_NEQ_OQ)));
+            __m256 s, c;
+            for (int it = 0; it < kKeplerIterations; ++it) {
+                sinCosAvx2(E, s, c);
+                __m256 f = _mm256_sub_ps(_mm256_fnmadd_ps(e, s, E), M);
+                __m256 df = _mm256_fnmadd_ps(e, c, one);
+                E = _mm256_sub_ps(E, _mm256_div_ps(f, df));
+            }
+            sinCosAvx2(E, s, c);
+
+            __m256 u = _mm256_mul_ps(_mm256_loadu_ps(&semiMajor[k]), _mm256_sub_ps(c, e));
+            __m256 w = _mm256_mul_ps(_mm256_loadu_ps(&semiMinor[k]), s);
+            _mm256_storeu_ps(x + k, _mm256_fmadd_ps(u, _mm256_loadu_ps(&px[k]), _mm256_mul_ps(w, _mm256_loadu_ps(&qx[k]))));
+            _mm256_storeu_ps(y + k, _mm256_fmadd_ps(u, _mm256_loadu_ps(&py[k]), _mm256_mul_ps(w, _mm256_loadu_ps(&qy[k]))));
+            _mm256_storeu_ps(z + k, _mm256_fmadd_ps(u, _mm256_loadu_ps(&pz[k]), _mm256_mul_ps(w, _mm256_loadu_ps(&qz[k]))));
+        }
+        for (; k < end; ++k) positionScalar(k, x, y, z);
+    }
+#endif
+
+    // AVX-512 machines take the AVX2 path; the solve is latency bound and
+    // the wider lanes gain little here
+    void positionsRange(size_t begin, size_t end, float* x, float* y, float* z) const {
+#if GRAVITY_SIMD_X86
+        if (simdLevel() != SIMD_SCALAR) {
+            positionsAvx2(begin, end, x, y, z);
+            return;
+        }
+#endif
+        for (size_t k = begin; k < end; ++k) positionScalar(k, x, y, z);
+    }
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include "gravity.h"
+
+// The 2D simulator's physics, kept apart from its GLFW window so the step
+// can be timed without a display. Positions are in screen pixels and
+// velocities in pixels per frame; gravity sees distances scaled up by
+// distanceScale.
+
+const float G = 6.67 * pow(10, -11);
+const float distanceScale = 75.0f;
+
+// The original per-body loop visited every pair from both ends and kicked
+// both bodies each time, so each pull acted twice a frame. The force stage
+// is the full direct-sum kernel rather than a pass over unordered pairs:
+// every body sums every other once, so each pull acts once, and this factor
+// keeps the motion the scenes were tuned for.
+const float kPairPullFactor = 2.0f;
+
+class Object {
+    public:
+
+    std::vector<float> position;
+    std::vector<float> velocity;
+    float radius;
+    float mass;
+
+    Object(std::vector<float> position, std::vector<float> velocity, float mass, float radius) {
+        this->position = position;
+        this->velocity = velocity;
+        this->radius = radius;
+        this->mass = mass;
+    }
+
+    void accelerate(float x, float y) {
+        this->velocity[0] += x / 60.0f;
+        this->velocity[1] += y / 60.0f;
+    }
+
+    void updatePos() {
+        this->position[0] += this->velocity[0];
+        this->position[1] += this->velocity[1];
+    }
+};
+
+struct ForceBuffers {
+    std::vector<float> x, y, z, mass, ax, ay, az;
+};
+
+inline void handleBorders(Object &obj, int fbW, int fbH) {
+
+    if (obj.position[1] < 0) {
+        obj.position[1] = 0; 
+        obj.velocity[1] *= -0.95f; 
+    }
+
+    if (obj.position[1] > fbH) {
+        obj.position[1] = fbH; 
+        obj.velocity[1] *= -0.95f;
+    }
+
+    if (obj.position[0] < 0) {
+        obj.position[0] = 0; 
+        obj.velocity[0] *= -0.65f;
+    }
+
+    if (obj.position[0] > fbW) {
+        obj.position[0] = fbW; 
+        obj.velocity[0] *= -0.65f;
+    }
+
+    if (obj.position[1] <= 0 && std::abs(obj.velocity[1]) < 0.5f) {
+        obj.velocity[1] = 0.0f;
+    }
+
+    return;
+}
+
+inline void handleCollision(Object &a, Object &b) {
+    float dx = b.position[0] - a.position[0];
+    float dy = b.position[1] - a.position[1];
+    float dist = std::sqrt(dx * dx + dy * dy);
+    float minDist = a.radius + b.radius;
+
+    if (dist < minDist && dist > 0.0f) {
+        float nx = dx / dist;
+        float ny = dy / dist;
+
+        float rvx = b.velocity[0] - a.velocity[0];
+        float rvy = b.velocity[1] - a.velocity[1];
+
+        float dot = rvx * nx + rvy * ny;
+
+        if (dot < 0) {
+            float bounce = 0.12f;
+
+            float totalMass = a.mass + b.mass;
+            float impulse = (-(1 + bounce) * dot) / totalMass;
+
+            a.velocity[0] -= impulse * b.mass * nx;
+            a.velocity[1] -= impulse * b.mass * ny;
+            b.velocity[0] += impulse * a.mass * nx;
+            b.velocity[1] += impulse * a.mass * ny;
+
+            float overlap = minDist - dist;
+            a.position[0] -= overlap * (b.mass / totalMass) * nx;
+            a.position[1] -= overlap * (b.mass / totalMass) * ny;
+            b.position[0] += overlap * (a.mass / totalMass) * nx;
+            b.position[1] += overlap * (a.mass / totalMass) * ny;
+        }
+    }
+}
+
+// gathers positions into flat arrays and runs the vectorized direct-sum
+// kernel. With distances scaled by distanceScale the pull of b on a is
+// G * mb * d / (distanceScale * |d|)^3, so the scale folds into G.
+inline void accumulateForces(std::vector<Object> &objects, ForceBuffers &buffers, ThreadPool &pool) {
+    size_t n = objects.size();
+    buffers.x.resize(n); buffers.y.resize(n); buffers.z.assign(n, 0.0f);
+    buffers.mass.resize(n);
+    buffers.ax.resize(n); buffers.ay.resize(n); buffers.az.resize(n);
+
+    for (size_t i = 0; i < n; ++i) {
+        buffers.x[i] = objects[i].position[0];
+        buffers.y[i] = objects[i].position[1];
+        buffers.mass[i] = objects[i].mass;
+    }
+
+    GravitySystem sys = {buffers.x.data(), buffers.y.data(), buffers.z.data(), buffers.mass.data(),
+                         buffers.ax.data(), buffers.ay.data(), buffers.az.data(), n, nullptr, 0};
+    GravityParams params = {kPairPullFactor * G / (distanceScale * distanceScale * distanceScale), 0.0f, 0.0f};
+    computeGravityDirect(sys, params, &pool);
+}
+
+inline void kick(std::vector<Object> &objects, const ForceBuffers &buffers, float fraction) {
+    for (size_t i = 0; i < objects.size(); ++i) {
+        objects[i].accelerate(buffers.ax[i] * fraction, buffers.ay[i] * fraction);
+    }
+}
+
+// resolves overlaps once per step, after every body has moved
+inline void handleCollisions(std::vector<Object> &objects) {
+    for (size_t i = 0; i < objects.size(); ++i) {
+        for (size_t j = i + 1; j < objects.size(); ++j) {
+            handleCollision(objects[i], objects[j]);
+        }
+    }
+}
+
+// One frame: kick-drift-kick leapfrog, whose closing kick's forces open the
+// next frame, then collisions. `forces` must hold the forces for the current
+// positions, from accumulateForces before the first frame.
+inline void stepObjects(std::vector<Object> &objects, ForceBuffers &forces, ThreadPool &pool, int fbW, int fbH) {
+    kick(objects, forces, 0.5f);
+    for (auto &obj : objects) {
+        obj.updatePos();
+        handleBorders(obj, fbW, fbH);
+    }
+    accumulateForces(objects, forces, pool);
+    kick(objects, forces, 0.5f);
+
+    handleCollisions(objects);
+}
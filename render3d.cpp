@@ -2,6 +2,7 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 #include "assets.h"
+#include "allocations.h"
 
 // helper functions
 static inline float radians(float deg) {return deg * 3.14159265f / 180.0f;}
@@ -22,18 +23,21 @@ vec3d cross(const vec3d& a, const vec3d& b) {
 
 // function declerations
 static GLFWwindow* StartGLFW();
-void updatePlanetPositions(std::vector<Body>& bodies, std::vector<OrbitParams>& orbits, float dt);
-void drawOrbitTrail(const std::vector<vec3d>& trail, const vec3d& color);
+void buildScriptedOrbits(KeplerOrbits& kepler, const std::vector<OrbitParams>& orbits,
+                         const std::vector<PerpendicularOrbiter>& perpOrbiters);
+void updateScriptedOrbits(BodyStore& bodies, KeplerOrbits& kepler, double time, ThreadPool* pool);
 void drawEllipticalOrbitGuide(const OrbitParams& orbit, const vec3d& color);
-void generateStars(std::vector<vec3d>& starPositions, std::vector<float>& starBrightness, int numStars);
-void drawStarField(const std::vector<vec3d>& starPositions, const std::vector<float>& starBrightness);
-void drawSpacetimeGrid(const std::vector<Body>& bodies);
-float calculateSpacetimeCurvature(const vec3d& point, const std::vector<Body>& bodies);
-void updatePerpendicularOrbiters(std::vector<Body>& bodies, std::vector<PerpendicularOrbiter>& perpOrbiters, 
-                                size_t perpStartIndex, float dt, float timeSpeed);
-void updateSupernova(SupernovaData& supernova, const std::vector<Body>& bodies, float dt, GLFWwindow* window);
-void drawSupernovaEffects(const SupernovaData& supernova, const std::vector<Body>& bodies);
-void drawWhiteFlash(float intensity);
+void recordSpacetimeGrid(RenderQueue::CommandList& list, const BodyStore& bodies, SpacetimeGrid& grid, float time);
+void recordWaveRings(RenderQueue::CommandList& list, const BodyStore& bodies, SpacetimeGrid& grid, float time);
+const char* gridBackendName(GridBackend backend);
+void seedOrbitalVelocities(BodyStore& bodies, const std::vector<PerpendicularOrbiter>& perpOrbiters, size_t perpStartIndex);
+void updateMutualGravity(BodyStore& bodies, GravitySolvers& solvers, PhysicsBackend backend,
+                         Integrator integrator, float dt);
+const char* physicsBackendName(PhysicsBackend backend);
+void updateSupernova(SupernovaData& supernova, const BodyStore& bodies, float dt, GLFWwindow* window);
+void recordSupernovaEffects(RenderQueue::CommandList& list, const SupernovaData& supernova, const BodyStore& bodies,
+                            SphereRenderer& spheres);
+void recordWhiteFlash(RenderQueue& queue, float intensity);
 void mouseCallback(GLFWwindow* window, double xpos, double ypos);
 void updateCameraVectors();  
 void initCameraAnglesFromCam();
@@ -48,8 +52,11 @@ float mouseSensitivity = 0.12f;
 vec3d cameraFront; 
 const vec3d worldUp = vec3d(0,0,1);
 Camera cam = {vec3d(200, -250, 100), vec3d(0, 0, 0), vec3d(0, 0, 1)};
-float timeSpeed = 1.0f;
+std::atomic<float> timeSpeed(1.0f);
 bool showSpacetimeGrid = true;
+std::atomic<PhysicsBackend> physicsBackend(SCRIPTED_ORBITS);
+std::atomic<Integrator> integrator(BLOCK_LEAPFROG);
+float pixelsPerUnit = 1.0f;     // screen pixels per world unit at unit distance, set with the projection
 
 int main(){
 
@@ -71,7 +78,7 @@ int main(){
     int fbW, fbH;
     glfwGetFramebufferSize(window, &fbW, &fbH);
 
-    std::vector<Body> bodies;
+    BodyStore bodies;
     bodies.push_back(Body(vec3d(0, 0, 0), vec3d(0, 0, 0), 1000.f, 20.f, vec3d(1.f, 0.95f, 0.1f)));
     
     std::vector<OrbitParams> planetOrbits = {
@@ -110,26 +117,62 @@ int main(){
 
     for (auto& orbit : planetOrbits) {
         orbit.angleVelocity = 2.0f * 3.14159f / orbit.orbitalPeriod;
-
-        float r = orbit.semiMajorAxis * (1.0f - orbit.eccentricity * cosf(orbit.currentAngle));
-        vec3d pos(r * cosf(orbit.currentAngle), r * sinf(orbit.currentAngle), 0);
-        
-        bodies.push_back(Body(pos, vec3d(0,0,0), 1.0f, orbit.radius, orbit.color));
+        bodies.push_back(Body(vec3d(0,0,0), vec3d(0,0,0), 1.0f, orbit.radius, orbit.color));
         
         std::cout << orbit.name << ": semi-major=" << orbit.semiMajorAxis 
                   << ", eccentricity=" << orbit.eccentricity 
                   << ", period=" << orbit.orbitalPeriod << " time units\n";
     }
 
-    std::vector<std::vector<vec3d>> orbitTrails(bodies.size());
+    GravitySolvers gravitySolvers;
+
+    // Render work has its own workers. A thread waiting in parallelFor runs
+    // whatever is queued on its pool, so grid tiles queued on the physics
+    // pool could land inside a force pass and make the tick late.
+    ThreadPool renderPool;
+    SpacetimeGrid spacetimeGrid(&renderPool);
+    SphereRenderer spheres;
+
+    // List 0 records on this thread, the others on renderPool, one per
+    // RecordJob. Sphere commands only queue instances; each run of them in
+    // one pass and state is drawn as one batch.
+    RenderQueue renderQueue(1 + RECORD_JOB_COUNT, kFrameArenaBytes);
+    renderQueue.setFlush(MATERIAL_SPHERES, [](void* renderer, uint8_t state) {
+        return static_cast<SphereRenderer*>(renderer)->draw((state & STATE_LIT) != 0);
+    }, &spheres);
+
+    // scripted mode places every orbiter from its elements at scriptedTime
+    KeplerOrbits keplerOrbits;
+    buildScriptedOrbits(keplerOrbits, planetOrbits, perpendicularOrbiters);
+    double scriptedTime = 0.0;
+    updateScriptedOrbits(bodies, keplerOrbits, scriptedTime, &gravitySolvers.pool);
+
+    TrailRings orbitTrails;
+    orbitTrails.init(bodies.size(), (int)kTrailLength);
     int trailUpdateCounter = 0;
 
-    std::vector<vec3d> starPositions;
-    std::vector<float> starBrightness;
-    generateStars(starPositions, starBrightness, 2000);
+    const char* starsEnv = std::getenv("GRAVITY_STARS");
+    size_t starCount = starsEnv ? (size_t)std::strtoull(starsEnv, nullptr, 10) : kStarCount;
+    StarCatalog starCatalog;
+    if (starCount >= kStarCacheMinimum) {
+        starCatalog.loadOrGenerate(kStarCachePath, starCount, kStarSeed, &renderPool);
+    } else {
+        starCatalog.generate(starCount, kStarSeed, &renderPool);
+    }
+    StarField starField;
+    starField.init(starCatalog);
+
+    // physics owns `bodies` on its own thread from here on; the render loop
+    // reads the published snapshots and blends the last two ticks
+    BodySnapshot initialSnapshot;
+    initialSnapshot.beginTick(bodies);
+    initialSnapshot.endTick(bodies, glfwGetTime());
+    TripleBuffer<BodySnapshot> snapshots(initialSnapshot);
+    BodyStore renderBodies = bodies;
+    std::atomic<bool> physicsRunning(true);
 
     // engine setup
-    bool paused = false;
+    std::atomic<bool> paused(false);
     bool showTrails = true;
     bool showOrbitGuides = false;
     int prevSpaceState = GLFW_RELEASE;
@@ -138,6 +181,10 @@ int main(){
     int prevRState = GLFW_RELEASE;
     int prevUpState = GLFW_RELEASE;
     int prevDownState = GLFW_RELEASE;
+    int prevPState = GLFW_RELEASE;
+    int prevIState = GLFW_RELEASE;
+    int prevCState = GLFW_RELEASE;
+    int prevFState = GLFW_RELEASE;
 
     double prevTime = glfwGetTime();
 
@@ -147,6 +194,7 @@ int main(){
     glEnable(GL_COLOR_MATERIAL);
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
     glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     GLfloat lightPos[] = {0.f, 0.f, 0.f, 1.0f};
     GLfloat lightColor[] = {1.f, 1.f, 0.8f, 1.f};
@@ -172,11 +220,67 @@ int main(){
     std::cout << "G: Toggle orbit guides\n";
     std::cout << "R: Toggle spacetime grid\n";
     std::cout << "Up/Down Arrow: Speed up/slow down time\n";
+    std::cout << "P: Cycle physics (scripted orbits / direct gravity / Barnes-Hut / FMM)\n";
+    std::cout << "I: Cycle integrator (Euler / leapfrog / block leapfrog / Forest-Ruth / Yoshida 6)\n";
+    std::cout << "C: Switch grid curvature (CPU field / vertex shader)\n";
+    std::cout << "F: Print last frame's render commands, state changes and draw calls\n";
     std::cout << "Shift: Fast camera movement\n";
     std::cout << "ESC: Exit\n\n";
     std::cout << "You're in for a surpise after 3 minuntes.\n";
 
+    std::thread physicsThread([&]() {
+        size_t perpStartIndex = planetOrbits.size() + 1;
+        PhysicsBackend activeBackend = SCRIPTED_ORBITS;
+        double nextTick = glfwGetTime();
+
+        while (physicsRunning.load(std::memory_order_relaxed)) {
+            double now = glfwGetTime();
+            if (now < nextTick) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(nextTick - now));
+                continue;
+            }
+            // skip ticks that can no longer be caught up instead of spiralling
+            if (now - nextTick > 0.25) nextTick = now;
+            nextTick += kDt;
+
+            PhysicsBackend requested = physicsBackend.load();
+            if (requested != activeBackend) {
+                if (activeBackend == SCRIPTED_ORBITS || requested == SCRIPTED_ORBITS) {
+                    gravitySolvers.invalidate(bodies);
+                } else {
+                    gravitySolvers.switchForces();
+                }
+                if (activeBackend == SCRIPTED_ORBITS) {
+                    seedOrbitalVelocities(bodies, perpendicularOrbiters, perpStartIndex);
+                }
+                activeBackend = requested;
+            }
+
+            BodySnapshot& snapshot = snapshots.back();
+            snapshot.beginTick(bodies);
+            if (!paused.load(std::memory_order_relaxed)) {
+                float speed = timeSpeed.load(std::memory_order_relaxed);
+                if (activeBackend == SCRIPTED_ORBITS) {
+                    scriptedTime += (double)kDt * speed;
+                    updateScriptedOrbits(bodies, keplerOrbits, scriptedTime, &gravitySolvers.pool);
+                } else {
+                    updateMutualGravity(bodies, gravitySolvers, activeBackend, integrator.load(), kDt * speed);
+                }
+            }
+            snapshot.endTick(bodies, glfwGetTime());
+            snapshots.publish();
+        }
+    });
+
+    // per-frame scratch lives in the queue's lists; the render loop should
+    // not touch the heap once warm
+    long long renderFrames = 0;
+    uint64_t steadyAllocations = 0;
+    const std::thread::id glThread = std::this_thread::get_id();
+
     while (!glfwWindowShouldClose(window)) {
+        renderQueue.begin();
+        uint64_t frameAllocations = allocationCount();
         glfwPollEvents();
         
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -187,7 +291,6 @@ int main(){
         int curSpace = glfwGetKey(window, GLFW_KEY_SPACE);
         if (curSpace == GLFW_PRESS && prevSpaceState == GLFW_RELEASE) {
             paused = !paused;
-            if (!paused) prevTime = glfwGetTime();
         }
         prevSpaceState = curSpace;
 
@@ -214,38 +317,64 @@ int main(){
 
         int curUp = glfwGetKey(window, GLFW_KEY_UP);
         if (curUp == GLFW_PRESS && prevUpState == GLFW_RELEASE) {
-            timeSpeed *= 1.5f;
+            timeSpeed = timeSpeed * 1.5f;
             std::cout << "Time speed: " << timeSpeed << "x" << std::endl;
         }
         prevUpState = curUp;
 
         int curDown = glfwGetKey(window, GLFW_KEY_DOWN);
         if (curDown == GLFW_PRESS && prevDownState == GLFW_RELEASE) {
-            timeSpeed /= 1.5f;
+            timeSpeed = timeSpeed / 1.5f;
             if (timeSpeed < 0.1f) timeSpeed = 0.1f;
             std::cout << "Time speed: " << timeSpeed << "x" << std::endl;
         }
         prevDownState = curDown;
 
+        int curP = glfwGetKey(window, GLFW_KEY_P);
+        if (curP == GLFW_PRESS && prevPState == GLFW_RELEASE) {
+            PhysicsBackend next = (PhysicsBackend)((physicsBackend + 1) % PHYSICS_BACKEND_COUNT);
+            physicsBackend = next;
+            std::cout << "Physics: " << physicsBackendName(next) << std::endl;
+        }
+        prevPState = curP;
+
+        int curI = glfwGetKey(window, GLFW_KEY_I);
+        if (curI == GLFW_PRESS && prevIState == GLFW_RELEASE) {
+            Integrator next = (Integrator)((integrator + 1) % INTEGRATOR_COUNT);
+            integrator = next;
+            std::cout << "Integrator: " << integratorScheme(next).name << std::endl;
+        }
+        prevIState = curI;
+
+        int curC = glfwGetKey(window, GLFW_KEY_C);
+        if (curC == GLFW_PRESS && prevCState == GLFW_RELEASE) {
+            spacetimeGrid.backend = (GridBackend)((spacetimeGrid.backend + 1) % GRID_BACKEND_COUNT);
+            std::cout << "Grid curvature: " << gridBackendName(spacetimeGrid.backend) << std::endl;
+        }
+        prevCState = curC;
+
+        int curF = glfwGetKey(window, GLFW_KEY_F);
+        if (curF == GLFW_PRESS && prevFState == GLFW_RELEASE) {
+            const RenderQueue::Stats& stats = renderQueue.stats();
+            std::cout << "Last frame: " << stats.commands << " commands, " << stats.stateChanges
+                      << " state changes, " << stats.drawCalls << " draw calls" << std::endl;
+        }
+        prevFState = curF;
+
         double now = glfwGetTime();
         double frameTime = now - prevTime;
         prevTime = now;
 
+        snapshots.acquire();
+        const BodySnapshot& snapshot = snapshots.front();
+        double sinceTick = (now - snapshot.tickTime) / kDt;
+        snapshot.interpolate((float)std::max(0.0, std::min(sinceTick, 1.0)), renderBodies);
+
+        bool appendTrails = false;
         if (!paused) {
-            frameTime = std::min(frameTime, 0.1);
-            updatePlanetPositions(bodies, planetOrbits, frameTime * timeSpeed);
-            
-            size_t perpStartIndex = planetOrbits.size() + 1;
-            updatePerpendicularOrbiters(bodies, perpendicularOrbiters, perpStartIndex, frameTime, timeSpeed);
-            
             trailUpdateCounter++;
             if (trailUpdateCounter >= 3) {
-                for (size_t i = 0; i < bodies.size(); ++i) {
-                    orbitTrails[i].push_back(bodies[i].pos);
-                    if (orbitTrails[i].size() > 800) {
-                        orbitTrails[i].erase(orbitTrails[i].begin());
-                    }
-                }
+                appendTrails = true;
                 trailUpdateCounter = 0;
             }
         }
@@ -265,6 +394,7 @@ int main(){
         if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS) cam.pos += worldUp * cameraSpeed;
 
         cam.target = cam.pos + forward;
+        spheres.setView(cam.pos.x, cam.pos.y, cam.pos.z, pixelsPerUnit);
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glLoadIdentity();
@@ -272,7 +402,7 @@ int main(){
                   cam.target.x, cam.target.y, cam.target.z,
                   cam.up.x, cam.up.y, cam.up.z);
 
-        updateSupernova(supernova, bodies, (float)frameTime, window);
+        updateSupernova(supernova, renderBodies, (float)frameTime, window);
 
         if (supernova.state == ENDING) {
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -281,84 +411,120 @@ int main(){
             continue;
         }
 
-        glDisable(GL_LIGHTING);
-        drawStarField(starPositions, starBrightness);
-        glEnable(GL_LIGHTING);
-
-        if (showSpacetimeGrid) {
-            glDisable(GL_LIGHTING);
-            drawSpacetimeGrid(bodies);
-            glEnable(GL_LIGHTING);
-        }
+        // Each pass records its draws and the queue runs them in pass order,
+        // switching state only between passes that need different state.
+        // Bodies go first so their halos, the sun's glow layers and the
+        // supernova shells blend over them instead of hiding them behind the
+        // halo's depth; all of those share the additive sphere batch.
+        float time = (float)glfwGetTime();
+        renderQueue.record(PASS_STARS, 0, MATERIAL_STARS, [&] { return starField.draw(time); });
 
         if (showOrbitGuides) {
-            glDisable(GL_LIGHTING);
-            for (size_t i = 0; i < planetOrbits.size(); ++i) {
-                drawEllipticalOrbitGuide(planetOrbits[i], planetOrbits[i].color * 0.3f);
-            }
-            glEnable(GL_LIGHTING);
-        }
-
-        if (showTrails) {
-            glDisable(GL_LIGHTING);
-            for (size_t i = 1; i < orbitTrails.size(); ++i) {
-                if (orbitTrails[i].size() > 1) {
-                    drawOrbitTrail(orbitTrails[i], bodies[i].color * 0.8f);
+            renderQueue.record(PASS_GUIDES, 0, MATERIAL_LINES, [&] {
+                for (size_t i = 0; i < planetOrbits.size(); ++i) {
+                    drawEllipticalOrbitGuide(planetOrbits[i], planetOrbits[i].color * 0.3f);
                 }
-            }
-            glEnable(GL_LIGHTING);
+                return (int)planetOrbits.size();
+            });
         }
 
-        drawSupernovaEffects(supernova, bodies);
-        drawWhiteFlash(supernova.whiteIntensity);
-
-        for (size_t i = 0; i < bodies.size(); ++i) {
-            if (i > 0 && bodies[i].radius > 15.0f) {
-                glDisable(GL_LIGHTING);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-                glPushMatrix();
-                glTranslatef(bodies[i].pos.x, bodies[i].pos.y, bodies[i].pos.z);
-                vec3d atmosColor = bodies[i].color * 0.8f;
-                glColor4f(atmosColor.x, atmosColor.y, atmosColor.z, 0.15f);
-                GLUquadric* atmosQuad = gluNewQuadric();
-                gluSphere(atmosQuad, bodies[i].radius * 1.3f, 20, 20);
-                gluDeleteQuadric(atmosQuad);
-                glPopMatrix();
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                glEnable(GL_LIGHTING);
+        renderQueue.record(PASS_OPAQUE, STATE_LIT, MATERIAL_SPHERES, [&] {
+            for (size_t i = 0; i < renderBodies.size(); ++i) {
+                ConstBodyRef body = renderBodies[i];
+                const vec3d& color = body.color();
+                spheres.add(sphereKey(i, SPHERE_BODY), 24, renderBodies.x[i], renderBodies.y[i], renderBodies.z[i],
+                            body.radius(), color.x, color.y, color.z, 1.0f);
             }
-            
-            bodies[i].draw();
-
-            if (i == 0) {
-                glDisable(GL_LIGHTING);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-                
-                float time = (float)glfwGetTime();
+            return 0;
+        });
+
+        renderQueue.record(PASS_ADDITIVE, STATE_ADDITIVE, MATERIAL_SPHERES, [&] {
+            for (size_t i = 1; i < renderBodies.size(); ++i) {
+                ConstBodyRef body = renderBodies[i];
+                if (body.radius() <= 15.0f) continue;
+                vec3d atmosColor = body.color() * 0.8f;
+                spheres.add(sphereKey(i, SPHERE_HALO), 20, renderBodies.x[i], renderBodies.y[i], renderBodies.z[i],
+                            body.radius() * 1.3f, atmosColor.x, atmosColor.y, atmosColor.z, 0.15f);
+            }
+            if (renderBodies.size() > 0) {
+                ConstBodyRef sun = renderBodies[0];
                 for (int glow = 0; glow < 5; ++glow) {
-                    glPushMatrix();
-                    glTranslatef(bodies[i].pos.x, bodies[i].pos.y, bodies[i].pos.z);
                     float pulse = 0.8f + 0.3f * sinf(time * 2.0f + glow * 0.5f);
-                    float glowSize = bodies[i].radius * (1.5f + glow * 0.4f) * pulse;
+                    float glowSize = sun.radius() * (1.5f + glow * 0.4f) * pulse;
                     float alpha = 0.2f / (glow + 1);
                     float r = 1.0f;
                     float g = 0.9f - glow * 0.15f;
                     float b = 0.1f - glow * 0.02f;
-                    
-                    glColor4f(r, g, b, alpha);
-                    GLUquadric* glowQuad = gluNewQuadric();
-                    gluSphere(glowQuad, glowSize, 20, 20);
-                    gluDeleteQuadric(glowQuad);
-                    glPopMatrix();
+                    spheres.add(sphereKey(0, SPHERE_GLOW + glow), 20, renderBodies.x[0], renderBodies.y[0],
+                                renderBodies.z[0], glowSize, r, g, b, alpha);
                 }
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                glEnable(GL_LIGHTING);
             }
-        }
+            return 0;
+        });
+
+        recordWhiteFlash(renderQueue, supernova.whiteIntensity);
+
+        // The heavier passes build their vertex data and commands on
+        // renderPool, each into its own list, while this thread helps; GL only
+        // sees them in submit(). The grid and the wave rings both read the
+        // field, so it is brought up to date first.
+        if (showSpacetimeGrid) spacetimeGrid.field.update(renderBodies);
+        uint64_t jobAllocations[RECORD_JOB_COUNT] = {};
+        renderPool.parallelFor(0, RECORD_JOB_COUNT, 1, [&](size_t begin, size_t end) {
+            for (size_t job = begin; job < end; ++job) {
+                uint64_t before = allocationCount();
+                RenderQueue::CommandList& list = renderQueue.list(1 + job);
+                switch ((RecordJob)job) {
+                    case RECORD_GRID:
+                        if (showSpacetimeGrid) recordSpacetimeGrid(list, renderBodies, spacetimeGrid, time);
+                        break;
+                    case RECORD_WAVE_RINGS:
+                        if (showSpacetimeGrid) recordWaveRings(list, renderBodies, spacetimeGrid, time);
+                        break;
+                    case RECORD_TRAILS:
+                        if (appendTrails) orbitTrails.append(renderBodies);
+                        if (showTrails) {
+                            list.record(PASS_TRAILS, 0, MATERIAL_TRAILS, [&] {
+                                return orbitTrails.draw(renderBodies, 1, 0.8f, time);
+                            });
+                        }
+                        break;
+                    case RECORD_SUPERNOVA:
+                        recordSupernovaEffects(list, supernova, renderBodies, spheres);
+                        break;
+                    default:
+                        break;
+                }
+                // a job this thread ran is already in frameAllocations
+                if (std::this_thread::get_id() != glThread) jobAllocations[job] = allocationCount() - before;
+            }
+        });
+        renderQueue.submit();
 
         glfwSwapBuffers(window);
+
+        if (++renderFrames > kAllocationWarmupFrames) {
+            uint64_t allocated = allocationCount() - frameAllocations;
+            for (uint64_t jobAllocated : jobAllocations) allocated += jobAllocated;
+            if (allocated && !steadyAllocations) {
+                std::cerr << "Render loop allocated " << allocated << " times in frame " << renderFrames << std::endl;
+            }
+            steadyAllocations += allocated;
+        }
     }
+
+    if (countingAllocations()) {
+        std::cout << "Heap allocations after warm-up: " << steadyAllocations << " over "
+                  << std::max(0LL, renderFrames - kAllocationWarmupFrames) << " frames" << std::endl;
+    }
+
+    physicsRunning = false;
+    physicsThread.join();
     
+    spacetimeGrid.mesh.destroy();
+    spheres.destroy();
+    orbitTrails.destroy();
+    starField.destroy();
     ma_engine_uninit(&engine);
     glfwTerminate();
     return 0;
@@ -373,13 +539,22 @@ static GLFWwindow* StartGLFW() {
     glfwMakeContextCurrent(win);
     glfwSwapInterval(1);
 
+    glewExperimental = GL_TRUE;
+    if (glewInit() != GLEW_OK) {
+        std::cerr << "Failed to init GLEW.\n";
+        glfwDestroyWindow(win);
+        glfwTerminate();
+        return nullptr;
+    }
+
     int fbW, fbH; 
     glfwGetFramebufferSize(win, &fbW, &fbH);
     glViewport(0, 0, fbW, fbH);
 
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
-    gluPerspective(55.0, (double)fbW / (double)fbH, 0.5, 3000.0);
+    gluPerspective(kFieldOfViewY, (double)fbW / (double)fbH, kNearPlane, kFarPlane);
+    pixelsPerUnit = 0.5f * fbH / tanf(radians(kFieldOfViewY) * 0.5f);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
     
@@ -442,323 +617,156 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
     updateCameraVectors();
 }
 
-void drawOrbitTrail(const std::vector<vec3d>& trail, const vec3d& color) {
-    if (trail.size() < 2) return;
-    
-    glLineWidth(3.0f);
-    glBegin(GL_LINE_STRIP);
-    for (size_t i = 0; i < trail.size(); ++i) {
-        float alpha = (float)i / (float)(trail.size() - 1);
-        alpha = alpha * alpha * alpha; 
-    
-        float shimmer = 0.8f + 0.2f * sinf((float)i * 0.1f + (float)glfwGetTime() * 3.0f);
-        
-        glColor4f(color.x * shimmer, color.y * shimmer, color.z * shimmer, alpha * 0.95f);
-        glVertex3f(trail[i].x, trail[i].y, trail[i].z);
-    }
-    glEnd();
-}
-
 void drawEllipticalOrbitGuide(const OrbitParams& orbit, const vec3d& color) {
     glLineWidth(1.5f);
     
     float pulse = 0.7f + 0.3f * sinf((float)glfwGetTime() * 1.5f);
     glColor4f(color.x, color.y, color.z, 0.5f * pulse);
     
+    // the Kepler ellipse with the sun at its focus, stepped in eccentric anomaly
+    float semiMinor = orbit.semiMajorAxis * sqrtf(1.0f - orbit.eccentricity * orbit.eccentricity);
     glBegin(GL_LINE_STRIP);
     for (int i = 0; i <= 128; ++i) {
         float angle = (float)i * 2.0f * 3.14159f / 128.0f;
-        float r = orbit.semiMajorAxis * (1.0f - orbit.eccentricity * cosf(angle));
-        float x = r * cosf(angle);
-        float y = r * sinf(angle);
+        float x = orbit.semiMajorAxis * (cosf(angle) - orbit.eccentricity);
+        float y = semiMinor * sinf(angle);
         glVertex3f(x, y, 0);
     }
     glEnd();
 }
 
-void generateStars(std::vector<vec3d>& starPositions, std::vector<float>& starBrightness, int numStars) {
-    starPositions.clear();
-    starBrightness.clear();
-    
-    srand(42);
-    
-    for (int i = 0; i < numStars; ++i) {
-        float distance = 800.0f + (rand() % 1000);
-        float theta = ((float)rand() / RAND_MAX) * 2.0f * 3.14159f;
-        float phi = ((float)rand() / RAND_MAX) * 3.14159f;
-        
-        vec3d pos;
-        pos.x = distance * sinf(phi) * cosf(theta);
-        pos.y = distance * sinf(phi) * sinf(theta);
-        pos.z = distance * cosf(phi);
-        
-        starPositions.push_back(pos);
-        
-        float brightness = powf((float)rand() / RAND_MAX, 1.8f);
-        starBrightness.push_back(brightness);
-    }
+// bend pulse shared by the grid lines and the wave rings
+static inline float gridPulse(float time) { return 0.85f + 0.15f * sinf(time * 0.4f); }
+
+static FieldGrid gridLayout() {
+    const float origin = -(kGridSize / 2) * kGridSpacing;
+    return FieldGrid{origin, origin, kGridSpacing, kGridBaseZ, kGridSize + 1, kGridSize + 1};
 }
 
-void drawStarField(const std::vector<vec3d>& starPositions, const std::vector<float>& starBrightness) {
-    glPointSize(1.0f);
-    glBegin(GL_POINTS);
-    
-    float time = (float)glfwGetTime();
-    
-    for (size_t i = 0; i < starPositions.size(); ++i) {
-        float brightness = starBrightness[i] * 1.15f;
-        
-        float twinkle = 0.6f + 0.4f * sinf(time * (2.0f + i * 0.01f));
-        brightness *= twinkle;
-        
-        float colorVar = (float)(i % 100) / 100.0f;
-        if (colorVar < 0.8f) {
-            glColor4f(brightness, brightness, brightness, brightness);
-        } else if (colorVar < 0.9f) {
-            glColor4f(brightness * 0.8f, brightness * 0.9f, brightness, brightness);
-        } else {
-            glColor4f(brightness, brightness * 0.7f, brightness * 0.4f, brightness);
-        }
-        
-        glVertex3f(starPositions[i].x, starPositions[i].y, starPositions[i].z);
-    }
-    glEnd();
+// CPU backend: re-evaluates and re-smooths the tiles near bodies that moved
+// into grid.smoothed
+static void smoothGridCurvature(const BodyStore& bodies, SpacetimeGrid& grid, FrameArena& scratch) {
+    const FieldGrid layout = gridLayout();
+
+    // the near-planet mask reaches further than a small planet's field, so
+    // footprints are widened to it and a moved planet also re-smooths there
+    grid.cache.update(layout, grid.field, kNearPlanetRadius);
+    grid.smoothed.resize((size_t)layout.nx * layout.ny);
+    grid.smoother.rasterizeMask(layout, bodies, kNearPlanetRadius, CurvatureField::kStarMass, scratch);
+
+    // a smoothed point reads its neighbours, so each redone tile is
+    // re-smoothed one point beyond its edges
+    grid.cache.forEachDirtyRegion(1, [&](int i0, int i1, int j0, int j1) {
+        grid.smoother.smooth(layout, grid.cache.values().data(), grid.smoothed.data(), i0, i1, j0, j1);
+    });
 }
 
-float calculateSpacetimeCurvature(const vec3d& point, const std::vector<Body>& bodies) {
-    float totalCurvature = 0.0f;
-    
-    for (const Body& body : bodies) {
-        vec3d diff = point - body.pos;
-        float distance = Length(diff);
-        
-        if (distance < 1e-6f) distance = 1e-6f;
-        
-        float maxInfluenceRadius;
-        float baseMultiplier;
-        float localIntensity;
-        
-        if (body.mass > 500.0f) {
-            maxInfluenceRadius = 160.0f; 
-            baseMultiplier = 20.0f;
-            localIntensity = 12.0f;
-        } else if (body.radius > 22.0f) {
-            maxInfluenceRadius = 95.0f;
-            baseMultiplier = 65.0f;
-            localIntensity = 50.0f; 
-        } else if (body.radius > 15.0f) { 
-            maxInfluenceRadius = 75.0f;
-            baseMultiplier = 60.0f;
-            localIntensity = 45.0f;
-        } else { 
-            maxInfluenceRadius = 55.0f;
-            baseMultiplier = 55.0f; 
-            localIntensity = 40.0f;
-        }
-        
-        if (distance > maxInfluenceRadius) continue;
-        
-        float influence = 0.0f;
-        
-        if (distance < maxInfluenceRadius * 0.5f) { 
-            float localFalloff = 1.0f - (distance / (maxInfluenceRadius * 0.5f));
-            localFalloff = localFalloff * localFalloff; 
-            influence += localIntensity * localFalloff;
-        }
-        
-        float normalizedDistance = distance / maxInfluenceRadius;
-        float broadFalloff = 1.0f - normalizedDistance;
-        broadFalloff = broadFalloff * broadFalloff * broadFalloff;
-        
-        float broadInfluence = body.mass * baseMultiplier * broadFalloff / (distance * distance + 3.0f);
-        influence += broadInfluence;
-        
-        if (body.mass <= 500.0f && distance < 25.0f) {
-            float spikeIntensity = 30.0f * expf(-distance / 8.0f);
-            influence += spikeIntensity;
-        }
-        
-        if (body.mass > 500.0f) {
-            float bowlEffect = 10.0f * expf(-distance / 50.0f);
-            influence += bowlEffect;
+// Runs on a worker once grid.field is up to date. The CPU backend's
+// curvature is computed here; the command only uploads and draws it. Bend
+// and colour are applied per vertex on the GPU; the shader backend
+// evaluates the field there too, and if its program turns out not to
+// build, the command falls back to the CPU field on the GL thread.
+void recordSpacetimeGrid(RenderQueue::CommandList& list, const BodyStore& bodies, SpacetimeGrid& grid, float time) {
+    const bool shader = grid.backend == GRID_VERTEX_SHADER && grid.mesh.canDrawField(bodies.size());
+    if (!shader) smoothGridCurvature(bodies, grid, list.arena());
+
+    const float pulse = gridPulse(time);
+    FrameArena& scratch = list.arena();
+    list.record(PASS_GRID, 0, MATERIAL_GRID_MESH, [&bodies, &grid, &scratch, shader, pulse] {
+        const FieldGrid layout = gridLayout();
+        glLineWidth(1.2f);
+        if (!grid.mesh.init(layout.nx, layout.ny, layout.originX, layout.originY, layout.spacing)) return 0;
+        if (shader) {
+            if (grid.mesh.drawField(bodies, kGridBaseZ, 3.5f, kGridMaxCurvature, pulse)) return 1;
+            smoothGridCurvature(bodies, grid, scratch);
         }
-        
-        totalCurvature += influence;
-    }
-    
-    return totalCurvature;
+        grid.mesh.upload(grid.smoothed.data());
+        grid.mesh.draw(kGridBaseZ, 3.5f, kGridMaxCurvature, pulse);
+        return 1;
+    });
 }
 
-void drawSpacetimeGrid(const std::vector<Body>& bodies) {
-    const int gridSize = 120; 
-    const float gridSpacing = 15.0f; 
-    const float maxCurvature = 60.0f; 
-    const float baseZ = 15.0f; 
-    
-    float time = (float)glfwGetTime();
-    float pulse = 0.85f + 0.15f * sinf(time * 0.4f);
-    
-    glLineWidth(1.2f);
-    
-    std::vector<std::vector<vec3d>> gridPoints(gridSize + 1, std::vector<vec3d>(gridSize + 1));
-    std::vector<std::vector<float>> curvatures(gridSize + 1, std::vector<float>(gridSize + 1));
-    
-    for (int i = 0; i <= gridSize; ++i) {
-        for (int j = 0; j <= gridSize; ++j) {
-            float x = (i - gridSize/2) * gridSpacing;
-            float y = (j - gridSize/2) * gridSpacing;
-            vec3d point(x, y, baseZ);
-            
-            float curvature = calculateSpacetimeCurvature(point, bodies);
-            curvatures[i][j] = curvature;
-        }
-    }
-    
-    std::vector<std::vector<float>> smoothedCurvatures = curvatures;
-    for (int i = 1; i < gridSize; ++i) {
-        for (int j = 1; j < gridSize; ++j) {
-            float currentCurvature = curvatures[i][j];
-            
-            bool nearPlanet = false;
-            float x = (i - gridSize/2) * gridSpacing;
-            float y = (j - gridSize/2) * gridSpacing;
-            vec3d gridPoint(x, y, baseZ);
-            
-            for (const Body& body : bodies) {
-                if (body.mass <= 500.0f) { 
-                    vec3d diff = gridPoint - body.pos;
-                    float distToPlanet = Length(diff);
-                    if (distToPlanet < 60.0f) { 
-                        nearPlanet = true;
-                        break;
-                    }
-                }
-            }
-            
-            if (nearPlanet) {
-                float sum = currentCurvature * 6.0f;
-                sum += curvatures[i-1][j] * 0.5f;
-                sum += curvatures[i+1][j] * 0.5f;
-                sum += curvatures[i][j-1] * 0.5f;
-                sum += curvatures[i][j+1] * 0.5f;
-                smoothedCurvatures[i][j] = sum / 8.0f;
-            } else {
-                float sum = 0.0f;
-                int count = 0;
-                
-                for (int di = -1; di <= 1; ++di) {
-                    for (int dj = -1; dj <= 1; ++dj) {
-                        int ni = i + di;
-                        int nj = j + dj;
-                        if (ni >= 0 && ni <= gridSize && nj >= 0 && nj <= gridSize) {
-                            float weight = (di == 0 && dj == 0) ? 4.0f : 1.0f;
-                            sum += curvatures[ni][nj] * weight;
-                            count += (int)weight;
-                        }
-                    }
-                }
-                smoothedCurvatures[i][j] = sum / (float)count;
-            }
-        }
-    }
-    
-    for (int i = 0; i <= gridSize; ++i) {
-        for (int j = 0; j <= gridSize; ++j) {
-            float x = (i - gridSize/2) * gridSpacing;
-            float y = (j - gridSize/2) * gridSpacing;
-            
-            float curvature = smoothedCurvatures[i][j];
-            
-            float bend = -curvature * 3.5f;
-            bend = std::max(bend, -maxCurvature);
-            
-            vec3d point(x, y, baseZ + bend);
-            gridPoints[i][j] = point;
-        }
+struct RingVertex {
+    float x, y, z;
+    float r, g, b, a;
+};
+
+// strips of one line width, drawn with one glMultiDrawArrays
+struct RingStrips {
+    GLint* first;
+    GLsizei* count;
+    GLsizei strips;
+};
+
+// Runs on a worker once grid.field is up to date. Wave rings sample a
+// finer height field of the orbital plane instead of summing the bodies at
+// every vertex. Its tiles follow the same dirty tracking as the grid;
+// points beyond it, or rings around bodies well off the plane, fall back
+// to the field itself. Every ring becomes a strip of coloured vertices in
+// the list's arena, and the command draws the rings and the wider bursts
+// with one call each.
+void recordWaveRings(RenderQueue::CommandList& list, const BodyStore& bodies, SpacetimeGrid& grid, float time) {
+    const int kRingSegments = 64;
+    const float ringSpacing = 5.0f;
+    const float ringExtent = -gridLayout().originX + 200.0f;     // grid plus the widest ring
+    const int ringPoints = (int)(2.0f * ringExtent / ringSpacing) + 1;
+    FieldGrid ringLayout = {-ringExtent, -ringExtent, ringSpacing, 0.0f, ringPoints, ringPoints};
+    grid.rings.update(ringLayout, grid.field);
+
+    float ringCos[kRingSegments + 1], ringSin[kRingSegments + 1];
+    for (int seg = 0; seg <= kRingSegments; ++seg) {
+        float angle = (float)seg * 2.0f * 3.14159f / (float)kRingSegments;
+        ringCos[seg] = cosf(angle);
+        ringSin[seg] = sinf(angle);
     }
-    
-    for (int i = 0; i <= gridSize; ++i) {
-        glBegin(GL_LINE_STRIP);
-        for (int j = 0; j <= gridSize; ++j) {
-            vec3d& point = gridPoints[i][j];
-            
-            float depthFromBase = baseZ - point.z;
-            float normalizedDepth = depthFromBase / maxCurvature;
-            normalizedDepth = std::max(0.0f, std::min(1.0f, normalizedDepth));
-            
-            float r, g, b;
-            if (normalizedDepth < 0.3f) {
-                float t = normalizedDepth / 0.3f;
-                r = g = b = 0.2f + t * 0.4f; 
-            } else if (normalizedDepth < 0.7f) {
-                float t = (normalizedDepth - 0.3f) / 0.4f;
-                r = g = b = 0.6f + t * 0.4f; 
-            } else {
-                float t = (normalizedDepth - 0.7f) / 0.3f;
-                r = 1.0f - t * 0.2f; 
-                g = 1.0f - t * 0.1f; 
-                b = 1.0f; 
-            }
-            
-            float alpha = 0.7f + normalizedDepth * 0.3f; 
-            
-            glColor4f(r * pulse, g * pulse, b * pulse, alpha * pulse);
-            glVertex3f(point.x, point.y, point.z);
+    auto ringHeight = [&](float px, float py, float pz) {
+        float curvature;
+        if (std::fabs(pz - ringLayout.z) > ringSpacing || !grid.rings.sample(px, py, curvature)) {
+            curvature = grid.field.at(px, py, pz);
         }
-        glEnd();
-    }
-    
-    for (int j = 0; j <= gridSize; ++j) {
-        glBegin(GL_LINE_STRIP);
-        for (int i = 0; i <= gridSize; ++i) {
-            vec3d& point = gridPoints[i][j];
-            
-            float depthFromBase = baseZ - point.z;
-            float normalizedDepth = depthFromBase / maxCurvature;
-            normalizedDepth = std::max(0.0f, std::min(1.0f, normalizedDepth));
-            
-            float r, g, b;
-            if (normalizedDepth < 0.3f) {
-                float t = normalizedDepth / 0.3f;
-                r = g = b = 0.2f + t * 0.4f;
-            } else if (normalizedDepth < 0.7f) {
-                float t = (normalizedDepth - 0.3f) / 0.4f;
-                r = g = b = 0.6f + t * 0.4f;
-            } else {
-                float t = (normalizedDepth - 0.7f) / 0.3f;
-                r = 1.0f - t * 0.2f;
-                g = 1.0f - t * 0.1f;
-                b = 1.0f;
-            }
-            
-            float alpha = 0.7f + normalizedDepth * 0.3f;
-            
-            glColor4f(r * pulse, g * pulse, b * pulse, alpha * pulse);
-            glVertex3f(point.x, point.y, point.z);
+        return kGridBaseZ + std::max(-curvature * 2.2f, -kGridMaxCurvature);
+    };
+
+    // at most 3 waves of 8 circles and one burst per body
+    FrameArena& scratch = list.arena();
+    const size_t maxRings = bodies.size() * 3 * 8, maxBursts = bodies.size();
+    RingVertex* vertices = scratch.allocate<RingVertex>((maxRings + maxBursts) * (kRingSegments + 1));
+    RingStrips rings = {scratch.allocate<GLint>(maxRings), scratch.allocate<GLsizei>(maxRings), 0};
+    RingStrips bursts = {scratch.allocate<GLint>(maxBursts), scratch.allocate<GLsizei>(maxBursts), 0};
+    GLint used = 0;
+    auto emitRing = [&](RingStrips& strips, const vec3d& center, float radius, float r, float g, float b, float a) {
+        strips.first[strips.strips] = used;
+        strips.count[strips.strips] = kRingSegments + 1;
+        ++strips.strips;
+        for (int seg = 0; seg <= kRingSegments; ++seg) {
+            float px = center.x + radius * ringCos[seg];
+            float py = center.y + radius * ringSin[seg];
+            vertices[used++] = RingVertex{px, py, ringHeight(px, py, center.z), r, g, b, a};
         }
-        glEnd();
-    }
-    
+    };
+
+    const float pulse = gridPulse(time);
     for (size_t bodyIdx = 0; bodyIdx < bodies.size(); ++bodyIdx) {
-        const Body& body = bodies[bodyIdx];
+        ConstBodyRef body = bodies[bodyIdx];
+        vec3d bodyPos = body.pos();
         
         bool isPerpendicularPlanet = false;
         if (bodyIdx >= bodies.size() - 2) { 
             isPerpendicularPlanet = true;
         }
         
-        if (body.mass > 0.5f && !isPerpendicularPlanet) { 
+        if (body.mass() > 0.5f && !isPerpendicularPlanet) { 
             int maxCircles;
             float baseSpacing;
             float pulseSpeed;
             float maxRadius;
             
-            if (body.mass > 500.0f) { 
+            if (body.mass() > 500.0f) { 
                 maxCircles = 8;
                 baseSpacing = 30.0f;
                 pulseSpeed = 1.2f;
                 maxRadius = 200.0f;
-            } else if (body.radius > 20.0f) { 
+            } else if (body.radius() > 20.0f) { 
                 maxCircles = 6;
                 baseSpacing = 22.0f;
                 pulseSpeed = 1.8f;
@@ -770,8 +778,6 @@ void drawSpacetimeGrid(const std::vector<Body>& bodies) {
                 maxRadius = 80.0f;
             }
             
-            glLineWidth(2.0f);
-            
             float bodyTime = time + (float)bodyIdx * 1.3f; 
             float pulsePhase = fmodf(bodyTime * pulseSpeed, 2.0f * 3.14159f);
             
@@ -787,127 +793,184 @@ void drawSpacetimeGrid(const std::vector<Body>& bodies) {
                     
                     if (actualRadius <= 5.0f || actualRadius > maxRadius) continue;
                     
-                    glBegin(GL_LINE_STRIP);
+                    float waveIntensity = (sinf(currentPhase - (float)circle * 0.3f) + 1.0f) * 0.5f;
+                    waveIntensity = waveIntensity * waveIntensity; 
                     
-                    for (int seg = 0; seg <= 64; ++seg) {
-                        float angle = (float)seg * 2.0f * 3.14159f / 64.0f;
-                        vec3d circlePoint = body.pos + vec3d(actualRadius * cosf(angle), actualRadius * sinf(angle), 0);
-                        
-                        float curvature = calculateSpacetimeCurvature(circlePoint, bodies);
-                        float bend = -curvature * 2.2f;
-                        bend = std::max(bend, -maxCurvature);
-                        
-                        circlePoint.z = baseZ + bend;
-                        
-                        float waveIntensity = (sinf(currentPhase - (float)circle * 0.3f) + 1.0f) * 0.5f;
-                        waveIntensity = waveIntensity * waveIntensity; 
-                        
-                        float distanceFade = 1.0f - (actualRadius / maxRadius);
-                        float waveFade = 1.0f - ((float)wave * 0.35f);
-                        
-                        float alpha = 0.8f * waveIntensity * distanceFade * waveFade * pulse;
-                        
-                        if (body.mass <= 500.0f) { 
-                            float colorPulse = 0.7f + 0.3f * waveIntensity;
-                            glColor4f(
-                                body.color.x * colorPulse, 
-                                body.color.y * colorPulse, 
-                                body.color.z * colorPulse, 
-                                alpha
-                            );
-                        } else { 
-                            float goldenPulse = 0.8f + 0.2f * waveIntensity;
-                            glColor4f(
-                                1.0f * goldenPulse, 
-                                0.9f * goldenPulse, 
-                                0.6f * goldenPulse, 
-                                alpha
-                            );
-                        }
-                        
-                        glVertex3f(circlePoint.x, circlePoint.y, circlePoint.z);
+                    float distanceFade = 1.0f - (actualRadius / maxRadius);
+                    float waveFade = 1.0f - ((float)wave * 0.35f);
+                    
+                    float alpha = 0.8f * waveIntensity * distanceFade * waveFade * pulse;
+                    
+                    if (body.mass() <= 500.0f) { 
+                        float colorPulse = 0.7f + 0.3f * waveIntensity;
+                        emitRing(rings, bodyPos, actualRadius,
+                                 body.color().x * colorPulse, 
+                                 body.color().y * colorPulse, 
+                                 body.color().z * colorPulse, 
+                                 alpha);
+                    } else { 
+                        float goldenPulse = 0.8f + 0.2f * waveIntensity;
+                        emitRing(rings, bodyPos, actualRadius,
+                                 1.0f * goldenPulse, 
+                                 0.9f * goldenPulse, 
+                                 0.6f * goldenPulse, 
+                                 alpha);
                     }
-                    glEnd();
                 }
             }
             
             float burstPhase = fmodf(bodyTime * pulseSpeed * 0.3f, 2.0f * 3.14159f);
             if (sinf(burstPhase) > 0.95f) { 
-                glLineWidth(3.0f);
-                
                 float burstRadius = baseSpacing * (2.0f + 3.0f * sinf(burstPhase * 4.0f));
                 if (burstRadius <= maxRadius) {
-                    glBegin(GL_LINE_STRIP);
+                    float burstAlpha = (sinf(burstPhase) - 0.95f) * 20.0f; 
                     
-                    for (int seg = 0; seg <= 64; ++seg) {
-                        float angle = (float)seg * 2.0f * 3.14159f / 64.0f;
-                        vec3d burstPoint = body.pos + vec3d(burstRadius * cosf(angle), burstRadius * sinf(angle), 0);
-                        
-                        float curvature = calculateSpacetimeCurvature(burstPoint, bodies);
-                        float bend = -curvature * 2.2f;
-                        bend = std::max(bend, -maxCurvature);
-                        
-                        burstPoint.z = baseZ + bend;
-                        
-                        float burstAlpha = (sinf(burstPhase) - 0.95f) * 20.0f; 
-                        
-                        if (body.mass <= 500.0f) {
-                            glColor4f(
-                                body.color.x * 1.5f, 
-                                body.color.y * 1.5f, 
-                                body.color.z * 1.5f, 
-                                burstAlpha
-                            );
-                        } else {
-                            glColor4f(1.2f, 1.1f, 0.8f, burstAlpha);
-                        }
-                        
-                        glVertex3f(burstPoint.x, burstPoint.y, burstPoint.z);
+                    if (body.mass() <= 500.0f) {
+                        emitRing(bursts, bodyPos, burstRadius,
+                                 body.color().x * 1.5f, 
+                                 body.color().y * 1.5f, 
+                                 body.color().z * 1.5f, 
+                                 burstAlpha);
+                    } else {
+                        emitRing(bursts, bodyPos, burstRadius, 1.2f, 1.1f, 0.8f, burstAlpha);
                     }
-                    glEnd();
                 }
             }
         }
     }
+    if (used == 0) return;
+
+    list.record(PASS_GRID, 0, MATERIAL_LINES, [vertices, rings, bursts] {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(RingVertex), &vertices->x);
+        glColorPointer(4, GL_FLOAT, sizeof(RingVertex), &vertices->r);
+        int draws = 0;
+        if (rings.strips > 0) {
+            glLineWidth(2.0f);
+            glMultiDrawArrays(GL_LINE_STRIP, rings.first, rings.count, rings.strips);
+            ++draws;
+        }
+        if (bursts.strips > 0) {
+            glLineWidth(3.0f);
+            glMultiDrawArrays(GL_LINE_STRIP, bursts.first, bursts.count, bursts.strips);
+            ++draws;
+        }
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        return draws;
+    });
 }
 
-void updatePlanetPositions(std::vector<Body>& bodies, std::vector<OrbitParams>& orbits, float dt) {
-    for (size_t i = 0; i < orbits.size(); ++i) {
-        OrbitParams& orbit = orbits[i];
-        
-        float currentRadius = orbit.semiMajorAxis * (1.0f - orbit.eccentricity * cosf(orbit.currentAngle));
-        
-        float speedMultiplier = orbit.semiMajorAxis / currentRadius;
-        speedMultiplier = powf(speedMultiplier, 1.8f); 
-        
-        orbit.currentAngle += orbit.angleVelocity * speedMultiplier * dt;
-        
-        while (orbit.currentAngle > 2.0f * 3.14159f) {
-            orbit.currentAngle -= 2.0f * 3.14159f;
+// orbit k of the combined list drives body k + 1: the planets first, then the
+// perpendicular orbiters from perpStartIndex on
+void buildScriptedOrbits(KeplerOrbits& kepler, const std::vector<OrbitParams>& orbits,
+                         const std::vector<PerpendicularOrbiter>& perpOrbiters) {
+    for (const auto& orbit : orbits) {
+        kepler.add(orbit.semiMajorAxis, orbit.eccentricity, orbit.orbitalPeriod, orbit.currentAngle,
+                   1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f);
+    }
+    for (const auto& perpOrb : perpOrbiters) {
+        kepler.add(perpOrb.radius, 0.0f, perpOrb.orbitalPeriod, perpOrb.currentAngle,
+                   1.0f, 0.0f, 0.0f, 0.0f, cosf(perpOrb.tiltAngle), sinf(perpOrb.tiltAngle));
+    }
+}
+
+void updateScriptedOrbits(BodyStore& bodies, KeplerOrbits& kepler, double time, ThreadPool* pool) {
+    if (bodies.size() < kepler.size() + 1) return;
+    kepler.propagate(time, bodies.x.data() + 1, bodies.y.data() + 1, bodies.z.data() + 1, pool);
+}
+
+void seedOrbitalVelocities(BodyStore& bodies, const std::vector<PerpendicularOrbiter>& perpOrbiters, size_t perpStartIndex) {
+    vec3d sunPos = bodies.pos(0);
+    float sunMass = bodies.mass[0];
+    bodies[0].setVel(vec3d(0, 0, 0));
+
+    for (size_t i = 1; i < bodies.size(); ++i) {
+        vec3d normal(0, 0, 1);
+        if (i >= perpStartIndex && i - perpStartIndex < perpOrbiters.size()) {
+            float tilt = perpOrbiters[i - perpStartIndex].tiltAngle;
+            normal = vec3d(0, -sinf(tilt), cosf(tilt));
         }
-        
-        float x = currentRadius * cosf(orbit.currentAngle);
-        float y = currentRadius * sinf(orbit.currentAngle);
-        
-        bodies[i + 1].pos = vec3d(x, y, 0);
-        
-        bodies[i + 1].pos.z = sinf(orbit.currentAngle * 3.0f) * 2.0f;
+
+        vec3d r = bodies.pos(i) - sunPos;
+        float dist = Length(r);
+        if (dist < 1e-3f) continue;
+
+        float speed = std::sqrt(kGravity * sunMass / dist);
+        bodies[i].setVel(Normalize(cross(normal, r)) * speed);
     }
 }
 
-void updatePerpendicularOrbiters(std::vector<Body>& bodies, std::vector<PerpendicularOrbiter>& perpOrbiters, 
-                                size_t perpStartIndex, float dt, float timeSpeed) {
-    for (size_t i = 0; i < perpOrbiters.size(); ++i) {
-        perpOrbiters[i].update(dt, timeSpeed);
-        vec3d newPos = perpOrbiters[i].getCurrentPosition();
-        
-        if (perpStartIndex + i < bodies.size()) {
-            bodies[perpStartIndex + i].pos = newPos;
+void updateMutualGravity(BodyStore& bodies, GravitySolvers& solvers, PhysicsBackend backend,
+                         Integrator integrator, float dt) {
+    // higher order schemes cost more force passes per step but take longer steps
+    float maxStep = kDt * integratorScheme(integrator).stepScale;
+    int steps = (int)ceilf(dt / maxStep);
+    steps = std::max(1, std::min(steps, kMaxPhysicsSubsteps));
+    float h = dt / (float)steps;
+
+    GravityParams params = {kGravity, kSoftening, kBarnesHutTheta};
+    GravityParams fmmParams = {kGravity, kSoftening, kFmmTheta};
+    GravitySystem sys = bodies.gravitySystem();
+
+    auto computeForcesFor = [&](const uint32_t* targets, size_t count) {
+        GravitySystem active = sys;
+        active.targets = targets;
+        active.targetCount = count;
+        switch (backend) {
+            case BARNES_HUT_GRAVITY:
+                computeGravityBarnesHut(active, params, solvers.tree, &solvers.pool);
+                break;
+            case FMM_GRAVITY:
+                solvers.fmm.compute(active, fmmParams, &solvers.pool);
+                break;
+            default:
+                computeGravityDirect(active, params, &solvers.pool);
+                break;
         }
+    };
+    auto computeForces = [&]() { computeForcesFor(nullptr, 0); };
+
+    // block timesteps keep their own per-body step sizes and half-kicked velocities
+    if (integrator == BLOCK_LEAPFROG) {
+        solvers.blockSteps.advance(bodies, dt, kMaxPhysicsSubsteps, computeForcesFor);
+        solvers.accelerationsValid = false;
+        return;
+    }
+    if (solvers.blockSteps.running()) {
+        solvers.blockSteps.synchronize(bodies);
+        solvers.accelerationsValid = false;
+    }
+
+    if (!solvers.accelerationsValid) {
+        computeForces();
+        solvers.accelerationsValid = true;
+    }
+    for (int step = 0; step < steps; ++step) {
+        bodies.step(integrator, h, computeForces);
     }
 }
 
-void updateSupernova(SupernovaData& supernova, const std::vector<Body>& bodies, float dt, GLFWwindow* window) {
+const char* physicsBackendName(PhysicsBackend backend) {
+    switch (backend) {
+        case SCRIPTED_ORBITS:    return "scripted orbits";
+        case DIRECT_GRAVITY:     return "direct-sum gravity";
+        case BARNES_HUT_GRAVITY: return "Barnes-Hut gravity";
+        case FMM_GRAVITY:        return "fast multipole gravity";
+        default:                 return "unknown";
+    }
+}
+
+const char* gridBackendName(GridBackend backend) {
+    switch (backend) {
+        case GRID_CPU_FIELD:     return "CPU field";
+        case GRID_VERTEX_SHADER: return "vertex shader";
+        default:                 return "unknown";
+    }
+}
+
+void updateSupernova(SupernovaData& supernova, const BodyStore& bodies, float dt, GLFWwindow* window) {
     const float SUPERNOVA_TIME = 173.0f; 
     
     supernova.timer += dt;
@@ -924,8 +987,8 @@ void updateSupernova(SupernovaData& supernova, const std::vector<Body>& bodies,
         supernova.explosionTimers.clear();
         supernova.explosionSizes.clear();
         
-        for (const auto& body : bodies) {
-            supernova.explosionCenters.push_back(body.pos);
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            supernova.explosionCenters.push_back(bodies.pos(i));
             supernova.explosionTimers.push_back(0.0f);
             supernova.explosionSizes.push_back(0.0f);
         }
@@ -985,111 +1048,93 @@ void updateSupernova(SupernovaData& supernova, const std::vector<Body>& bodies,
     }
 }
 
-void drawSupernovaEffects(const SupernovaData& supernova, const std::vector<Body>& bodies) {
+struct ShellSphere {
+    uint32_t lodKey;
+    int maxDetail;
+    float x, y, z, radius;
+    float r, g, b, a;
+};
+
+// Runs on a worker. The shells are worked out into the list's arena and
+// the command only queues them, joining the halos and sun glow in the
+// additive sphere batch.
+void recordSupernovaEffects(RenderQueue::CommandList& list, const SupernovaData& supernova, const BodyStore& bodies,
+                            SphereRenderer& spheres) {
     if (!supernova.supernovaTriggered) return;
-    
-    glDisable(GL_LIGHTING);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-    
+    if (supernova.state != PRIMING && supernova.state != EXPLODING) return;
+
+    size_t maxShells = std::max(bodies.size() * 6, supernova.explosionCenters.size() * 5);
+    ShellSphere* shells = list.arena().allocate<ShellSphere>(maxShells);
+    size_t count = 0;
     switch (supernova.state) {
         case PRIMING: {
             float pulseIntensity = 0.5f + 0.5f * sinf(supernova.timer * 8.0f);
-            
+        
             for (size_t i = 0; i < bodies.size(); ++i) {
-                const Body& body = bodies[i];
-                
-                glPushMatrix();
-                glTranslatef(body.pos.x, body.pos.y, body.pos.z);
-                
+                ConstBodyRef body = bodies[i];
                 for (int layer = 0; layer < 6; ++layer) {
-                    float layerSize = body.radius * (2.0f + layer * 0.8f) * pulseIntensity;
+                    float layerSize = body.radius() * (2.0f + layer * 0.8f) * pulseIntensity;
                     float alpha = 0.3f / (layer + 1) * pulseIntensity;
-                    
+                
                     float timeIntensity = supernova.timer / 3.0f;
-                    vec3d glowColor = body.color * (1.0f + timeIntensity * 2.0f);
-                    
-                    glColor4f(glowColor.x, glowColor.y, glowColor.z, alpha);
-                    
-                    GLUquadric* quad = gluNewQuadric();
-                    gluSphere(quad, layerSize, 16, 16);
-                    gluDeleteQuadric(quad);
-                }
+                    vec3d glowColor = body.color() * (1.0f + timeIntensity * 2.0f);
                 
-                glPopMatrix();
+                    shells[count++] = ShellSphere{sphereKey(i, SPHERE_PRIMING + layer), 16, bodies.x[i], bodies.y[i],
+                                                  bodies.z[i], layerSize, glowColor.x, glowColor.y, glowColor.z, alpha};
+                }
             }
             break;
         }
-        
+    
         case EXPLODING: {
             for (size_t i = 0; i < supernova.explosionCenters.size(); ++i) {
                 const vec3d& center = supernova.explosionCenters[i];
                 float explosionSize = supernova.explosionSizes[i];
                 float explosionTime = supernova.explosionTimers[i];
-                
+            
                 if (explosionSize > 0.0f) {
-                    glPushMatrix();
-                    glTranslatef(center.x, center.y, center.z);
-                    
                     for (int ring = 0; ring < 5; ++ring) {
                         float ringSize = explosionSize * (0.6f + ring * 0.2f);
                         float alpha = std::max(0.0f, 0.8f - explosionTime * 0.3f - ring * 0.1f);
-                        
+                    
                         float r = 1.0f;
                         float g = 1.0f - explosionTime * 0.2f;
                         float b = std::max(0.0f, 0.8f - explosionTime * 0.4f);
-                        
-                        glColor4f(r, g, b, alpha);
-                        
-                        GLUquadric* explosionQuad = gluNewQuadric();
-                        gluSphere(explosionQuad, ringSize, 20, 20);
-                        gluDeleteQuadric(explosionQuad);
-                    }
                     
-                    glPopMatrix();
+                        shells[count++] = ShellSphere{sphereKey(i, SPHERE_EXPLOSION + ring), 20, center.x, center.y,
+                                                      center.z, ringSize, r, g, b, alpha};
+                    }
                 }
             }
             break;
         }
-        
+    
         default:
             break;
     }
-    
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_LIGHTING);
+
+    list.record(PASS_SUPERNOVA, STATE_ADDITIVE, MATERIAL_SPHERES, [shells, count, &spheres] {
+        for (size_t k = 0; k < count; ++k) {
+            const ShellSphere& s = shells[k];
+            spheres.add(s.lodKey, s.maxDetail, s.x, s.y, s.z, s.radius, s.r, s.g, s.b, s.a);
+        }
+        return 0;
+    });
 }
 
-void drawWhiteFlash(float intensity) {
+// full-screen quad over the scene drawn so far; the bodies and their glows
+// draw over it. The queue sets up the unit square.
+void recordWhiteFlash(RenderQueue& queue, float intensity) {
     if (intensity <= 0.0f) return;
-    
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    glOrtho(0, 1, 0, 1, -1, 1);
-    
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
-    
-    glColor4f(1.0f, 1.0f, 1.0f, intensity);
-    glBegin(GL_QUADS);
-    glVertex2f(0.0f, 0.0f);
-    glVertex2f(1.0f, 0.0f);
-    glVertex2f(1.0f, 1.0f);
-    glVertex2f(0.0f, 1.0f);
-    glEnd();
-    
-    glPopMatrix();
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-}
\ No newline at end of file
+
+    queue.record(PASS_FLASH, STATE_NO_DEPTH | STATE_SCREEN, MATERIAL_FLASH, [intensity] {
+        glColor4f(1.0f, 1.0f, 1.0f, intensity);
+        glBegin(GL_QUADS);
+        glVertex2f(0.0f, 0.0f);
+        glVertex2f(1.0f, 0.0f);
+        glVertex2f(1.0f, 1.0f);
+        glVertex2f(0.0f, 1.0f);
+        glEnd();
+        return 1;
+    });
+}
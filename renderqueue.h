@@ -0,0 +1,235 @@
+#pragma once
+#include <GL/glew.h>
+#include <new>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "arena.h"
+
+// Passes in the order they reach the screen.
+enum RenderPass {
+    PASS_STARS,
+    PASS_GRID,
+    PASS_GUIDES,
+    PASS_TRAILS,
+    PASS_SUPERNOVA,     // shells around the bodies, drawn under them
+    PASS_FLASH,         // full-screen white that the bodies still draw over
+    PASS_OPAQUE,
+    PASS_ADDITIVE,
+    RENDER_PASS_COUNT
+};
+
+// Pipeline state a command runs under, as bits; 0 is unlit alpha blending
+// with the depth test on and the camera matrices.
+enum RenderState : uint8_t {
+    STATE_LIT      = 1 << 0,    // GL_LIGHTING
+    STATE_ADDITIVE = 1 << 1,    // GL_SRC_ALPHA, GL_ONE instead of GL_ONE_MINUS_SRC_ALPHA
+    STATE_NO_DEPTH = 1 << 2,    // depth test off
+    STATE_SCREEN   = 1 << 3,    // unit square orthographic projection, identity modelview
+};
+
+// What a command draws with. Within a pass and state, commands are grouped
+// by material in this order.
+enum RenderMaterial : uint16_t {
+    MATERIAL_STARS,
+    MATERIAL_GRID_MESH,
+    MATERIAL_LINES,
+    MATERIAL_TRAILS,
+    MATERIAL_SPHERES,
+    MATERIAL_FLASH,
+    RENDER_MATERIAL_COUNT
+};
+
+// A frame's draws as command lists. Passes record commands in any order,
+// each a callable tagged with its pass, state and material; submit() sorts
+// them by (pass, state, material, list, recording order), sets only the
+// state that differs from the previous command and runs them. Commands
+// keep their list and recording order within a (pass, state, material)
+// group, so blended draws that depend on order still come out in it, and
+// the order does not depend on which thread finished first.
+//
+// Every list has its own vector and scratch arena, so one thread per list
+// can record at a time without locks: list 0 belongs to the GL thread and
+// the others go to workers that build their pass's vertex data while
+// recording. Only submit() touches GL, and it must not overlap recording.
+//
+// A material can have a batch flush: commands of a batching material only
+// queue work (sphere instances, say) and the flush draws it once the group
+// ends, so every command of one material and state within a pass becomes
+// one batch however many places recorded into it.
+//
+// Callables live in their list's arena until the next begin(), and so
+// must be trivially destructible: lambdas capturing references or plain
+// values. Each returns the number of GL draw calls it issued, which, with
+// the state changes, is counted per frame in stats().
+
+class RenderQueue {
+public:
+    struct Stats {
+        int commands = 0;
+        int stateChanges = 0;
+        int drawCalls = 0;
+    };
+
+    // draws what a group of `material` commands queued; returns its draw calls
+    typedef int (*FlushFn)(void* context, uint8_t state);
+
+private:
+    struct Command {
+        uint64_t key;
+        int (*run)(const void* callable);
+        const void* callable;
+    };
+
+public:
+    class CommandList {
+    public:
+        explicit CommandList(size_t arenaBytes) : scratch(arenaBytes) {}
+        CommandList(const CommandList&) = delete;
+        CommandList& operator=(const CommandList&) = delete;
+
+        // per-frame scratch for the pass's vertex data, valid until the next begin()
+        FrameArena& arena() { return scratch; }
+
+        template <typename Fn>
+        void record(RenderPass pass, uint8_t state, RenderMaterial material, const Fn& fn) {
+            Fn* stored = new (scratch.allocate<Fn>(1)) Fn(fn);
+            uint64_t key = (uint64_t)pass << 56 | (uint64_t)state << 48 | (uint64_t)material << 32 |
+                           (uint64_t)id << 24 | (uint64_t)commands.size();
+            commands.push_back(Command{key, &invoke<Fn>, stored});
+        }
+
+    private:
+        friend class RenderQueue;
+        std::vector<Command> commands;
+        FrameArena scratch;
+        uint32_t id = 0;
+    };
+
+    // listCount lists (at most 256) of up to 2^24 commands a frame, each
+    // arena starting at arenaBytes
+    RenderQueue(size_t listCount, size_t arenaBytes) {
+        for (size_t i = 0; i < listCount; ++i) {
+            lists.emplace_back(new CommandList(arenaBytes));
+            lists.back()->id = (uint32_t)i;
+        }
+    }
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    void setFlush(RenderMaterial material, FlushFn flush, void* context) {
+        flushes[material] = Flush{flush, context};
+    }
+
+    size_t listCount() const { return lists.size(); }
+    CommandList& list(size_t i) { return *lists[i]; }
+
+    // starts a frame: empties every list and hands back its arena
+    void begin() {
+        for (auto& list : lists) {
+            list->commands.clear();
+            list->scratch.reset();
+        }
+    }
+
+    // records into the GL thread's list
+    template <typename Fn>
+    void record(RenderPass pass, uint8_t state, RenderMaterial material, const Fn& fn) {
+        lists[0]->record(pass, state, material, fn);
+    }
+
+    // Runs the list on the GL thread. The state of the last command stays
+    // set for the next frame's first one, except the screen matrices, which
+    // are popped so the next frame's camera goes onto the usual stack.
+    void submit() {
+        commands.clear();
+        for (auto& list : lists) commands.insert(commands.end(), list->commands.begin(), list->commands.end());
+        std::sort(commands.begin(), commands.end(),
+                  [](const Command& a, const Command& b) { return a.key < b.key; });
+
+        frameStats = Stats();
+        frameStats.commands = (int)commands.size();
+        for (size_t i = 0; i < commands.size(); ++i) {
+            const Command& command = commands[i];
+            uint8_t state = stateOf(command.key);
+            if (state != current) {
+                apply(current, state);
+                current = state;
+            }
+            frameStats.drawCalls += command.run(command.callable);
+
+            bool groupEnds = i + 1 == commands.size() || (commands[i + 1].key >> 32) != (command.key >> 32);
+            const Flush& flush = flushes[materialOf(command.key)];
+            if (groupEnds && flush.fn) frameStats.drawCalls += flush.fn(flush.context, state);
+        }
+        if (current & STATE_SCREEN) {
+            apply(current, current & ~STATE_SCREEN);
+            current &= ~STATE_SCREEN;
+        }
+        commands.clear();
+    }
+
+    // counts of the last submit()
+    const Stats& stats() const { return frameStats; }
+
+    // the state GL is set up in before the first submit()
+    static const uint8_t kInitialState = STATE_LIT;
+
+private:
+    struct Flush {
+        FlushFn fn = nullptr;
+        void* context = nullptr;
+    };
+
+    std::vector<std::unique_ptr<CommandList>> lists;
+    std::vector<Command> commands;      // every list's commands, merged for sorting
+    Flush flushes[RENDER_MATERIAL_COUNT];
+    Stats frameStats;
+    uint8_t current = kInitialState;
+
+    template <typename Fn>
+    static int invoke(const void* callable) {
+        return (*static_cast<const Fn*>(callable))();
+    }
+
+    static uint8_t stateOf(uint64_t key) { return (uint8_t)(key >> 48); }
+    static RenderMaterial materialOf(uint64_t key) { return (RenderMaterial)(uint16_t)(key >> 32); }
+
+    // one GL change per differing bit, counted
+    void apply(uint8_t from, uint8_t to) {
+        uint8_t changed = from ^ to;
+        if (changed & STATE_LIT) {
+            if (to & STATE_LIT) glEnable(GL_LIGHTING);
+            else glDisable(GL_LIGHTING);
+            ++frameStats.stateChanges;
+        }
+        if (changed & STATE_ADDITIVE) {
+            glBlendFunc(GL_SRC_ALPHA, (to & STATE_ADDITIVE) ? GL_ONE : GL_ONE_MINUS_SRC_ALPHA);
+            ++frameStats.stateChanges;
+        }
+        if (changed & STATE_NO_DEPTH) {
+            if (to & STATE_NO_DEPTH) glDisable(GL_DEPTH_TEST);
+            else glEnable(GL_DEPTH_TEST);
+            ++frameStats.stateChanges;
+        }
+        if (changed & STATE_SCREEN) {
+            if (to & STATE_SCREEN) {
+                glMatrixMode(GL_PROJECTION);
+                glPushMatrix();
+                glLoadIdentity();
+                glOrtho(0, 1, 0, 1, -1, 1);
+                glMatrixMode(GL_MODELVIEW);
+                glPushMatrix();
+                glLoadIdentity();
+            } else {
+                glMatrixMode(GL_PROJECTION);
+                glPopMatrix();
+                glMatrixMode(GL_MODELVIEW);
+                glPopMatrix();
+            }
+            ++frameStats.stateChanges;
+        }
+    }
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include <GL/glew.h>
+#include <iostream>
+#include <vector>
+
+// GLSL 1.20 programs for the compatibility profile. The fixed-function
+// matrices stay in charge of the camera, so shaders read
+// gl_ModelViewProjectionMatrix and draw alongside the immediate mode code.
+
+static inline GLuint compileShaderStage(GLenum type, const char* source, const char* name) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length > 1 ? length : 1, '\0');
+        glGetShaderInfoLog(shader, (GLsizei)log.size(), nullptr, log.data());
+        std::cerr << "Failed to compile " << name << (type == GL_VERTEX_SHADER ? " vertex" : " fragment")
+                  << " shader:\n" << log.data() << "\n";
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Links a program with attribs[k] bound to attribute location k, so the
+// first one also stands in for gl_Vertex. Returns 0 and logs on failure.
+static inline GLuint buildProgram(const char* name, const char* vertexSource, const char* fragmentSource,
+                                  const std::vector<const char*>& attribs) {
+    GLuint vs = compileShaderStage(GL_VERTEX_SHADER, vertexSource, name);
+    GLuint fs = compileShaderStage(GL_FRAGMENT_SHADER, fragmentSource, name);
+    if (!vs || !fs) {
+        if (vs) glDeleteShader(vs);
+        if (fs) glDeleteShader(fs);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    for (size_t k = 0; k < attribs.size(); ++k) glBindAttribLocation(program, (GLuint)k, attribs[k]);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        std::vector<char> log(length > 1 ? length : 1, '\0');
+        glGetProgramInfoLog(program, (GLsizei)log.size(), nullptr, log.data());
+        std::cerr << "Failed to link " << name << " program:\n" << log.data() << "\n";
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Runtime instruction set selection. Vector kernels are compiled per
+// function with target attributes, so the program itself needs no -mavx
+// flags and still runs on CPUs (or architectures) without them.
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    #define GRAVITY_SIMD_X86 1
+    #include <immintrin.h>
+    #define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+    #define SIMD_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+    #define GRAVITY_SIMD_X86 0
+#endif
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_AVX2,      // 8 floats per instruction
+    SIMD_AVX512     // 16 floats per instruction
+};
+
+// cpuid feature bits (the builtins also check that the OS saves the wider
+// register state), evaluated once
+static inline SimdLevel detectSimdLevel() {
+#if GRAVITY_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SIMD_AVX2;
+#endif
+    return SIMD_SCALAR;
+}
+
+static inline SimdLevel simdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+static inline const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX512: return "AVX-512";
+        case SIMD_AVX2:   return "AVX2";
+        default:          return "scalar";
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include "simd.h"
+#include "field.h"
+#include "arena.h"
+
+// Smoothing of the raw grid curvature before it is drawn. Interior points
+// near a planet keep most of their own value,
+//   cross  (6 c + 0.5 (N + S + E + W)) / 8
+// and every other interior point gets the weighted box
+//   box    (4 c + the 8 neighbours) / 12
+// while border points are copied unchanged.
+//
+// Both kernels are sums of 1D passes: one vertical pass over three rows
+// gives the column sums and the N + S pair, the horizontal pass adds the
+// neighbouring columns. Both results are computed for every point and the
+// near-planet mask picks one, so the inner loops have no branches and run
+// 8 points per vector. The mask is rasterized body by body over each
+// body's bounding square, instead of scanning every body at every point.
+
+class CurvatureSmoother {
+public:
+    // Marks the points of grid closer than radius (in 3D) to any body of
+    // mass at most maxMass, the same test the smoothing always used. The
+    // mask and the row scratch come from the frame arena, so smooth() must
+    // run in the same frame.
+    template <typename Store>
+    void rasterizeMask(const FieldGrid& grid, const Store& bodies, float radius, float maxMass, FrameArena& scratch) {
+        mask = scratch.allocate<uint32_t>((size_t)grid.nx * grid.ny);
+        columns = scratch.allocate<float>((size_t)grid.ny);
+        pairs = scratch.allocate<float>((size_t)grid.ny);
+        std::fill(mask, mask + (size_t)grid.nx * grid.ny, 0u);
+        for (size_t b = 0; b < bodies.size(); ++b) {
+            if (bodies.mass[b] > maxMass) continue;
+            float bx = bodies.x[b], by = bodies.y[b], dz = grid.z - bodies.z[b];
+            if (std::fabs(dz) >= radius) continue;
+
+            int i0 = std::max(0, pointIndex((bx - radius - grid.originX) / grid.spacing, grid.nx));
+            int i1 = std::min(grid.nx - 1, pointIndex((bx + radius - grid.originX) / grid.spacing + 1.0f, grid.nx));
+            int j0 = std::max(0, pointIndex((by - radius - grid.originY) / grid.spacing, grid.ny));
+            int j1 = std::min(grid.ny - 1, pointIndex((by + radius - grid.originY) / grid.spacing + 1.0f, grid.ny));
+            for (int i = i0; i <= i1; ++i) {
+                float dx = grid.originX + i * grid.spacing - bx;
+                for (int j = j0; j <= j1; ++j) {
+                    float dy = grid.originY + j * grid.spacing - by;
+                    if (std::sqrt(dx*dx + dy*dy + dz*dz) < radius) mask[(size_t)i * grid.ny + j] = ~0u;
+                }
+            }
+        }
+    }
+
+    // smooths the points [i0, i1) x [j0, j1) of raw into out; both use the
+    // grid's i * ny + j layout and the mask must be current
+    void smooth(const FieldGrid& grid, const float* raw, float* out, int i0, int i1, int j0, int j1) const {
+        const int ny = grid.ny;
+        for (int i = i0; i < i1; ++i) {
+            if (i == 0 || i == grid.nx - 1) {
+                std::copy(raw + (size_t)i * ny + j0, raw + (size_t)i * ny + j1, out + (size_t)i * ny + j0);
+                continue;
+            }
+            if (j0 == 0) out[(size_t)i * ny] = raw[(size_t)i * ny];
+            if (j1 == ny) out[(size_t)i * ny + ny - 1] = raw[(size_t)i * ny + ny - 1];
+            int a = std::max(j0, 1), b = std::min(j1, ny - 1);
+            if (a < b) smoothRow(raw + (size_t)i * ny, ny, out + (size_t)i * ny, &mask[(size_t)i * ny], a, b);
+        }
+    }
+
+private:
+    uint32_t* mask = nullptr;               // ~0u near a planet, same layout as the grid
+    float* columns = nullptr;               // vertical pass of the current row: 3-row sums
+    float* pairs = nullptr;                 // and N + S
+
+    // float cell coordinate to an index, clamped before the cast
+    static int pointIndex(float v, int count) {
+        return (int)std::min(std::max(v, -1.0f), (float)count);
+    }
+
+    // interior row: row[-ny], row[0] and row[ny] are the rows above, at and below
+    void smoothRow(const float* row, int ny, float* out, const uint32_t* nearMask, int a, int b) const {
+        for (int j = a - 1; j <= b; ++j) {
+            float vertical = row[j - ny] + row[j + ny];
+            pairs[j] = vertical;
+            columns[j] = vertical + row[j];
+        }
+#if GRAVITY_SIMD_X86
+        if (simdLevel() != SIMD_SCALAR) {
+            smoothRowAvx2(row, out, nearMask, a, b);
+            return;
+        }
+#endif
+        for (int j = a; j < b; ++j) out[j] = smoothPoint(row, nearMask, j);
+    }
+
+    float smoothPoint(const float* row, const uint32_t* nearMask, int j) const {
+        float c = row[j];
+        float cross = c * 0.75f + (pairs[j] + row[j - 1] + row[j + 1]) * 0.0625f;
+        float box = (columns[j - 1] + columns[j] + columns[j + 1] + c * 3.0f) * (1.0f / 12.0f);
+        return nearMask[j] ? cross : box;
+    }
+
+#if GRAVITY_SIMD_X86
+    SIMD_TARGET_AVX2 void smoothRowAvx2(const float* row, float* out, const uint32_t* nearMask, int a, int b) const {
+        const __m256 crossCenter = _mm256_set1_ps(0.75f);
+        const __m256 crossSide = _mm256_set1_ps(0.0625f);
+        const __m256 boxCenter = _mm256_set1_ps(3.0f);
+        const __m256 boxScale = _mm256_set1_ps(1.0f / 12.0f);
+
+        int j = a;
+        for (; j + 8 <= b; j += 8) {
+            __m256 c = _mm256_loadu_ps(row + j);
+            __m256 sides = _mm256_add_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1));
+            __m256 neighbours = _mm256_add_ps(_mm256_loadu_ps(&pairs[j]), sides);
+            __m256 cross = _mm256_fmadd_ps(neighbours, crossSide, _mm256_mul_ps(c, crossCenter));
+
+            __m256 columnSum = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(&columns[j - 1]), _mm256_loadu_ps(&columns[j])),
+                                             _mm256_loadu_ps(&columns[j + 1]));
+            __m256 box = _mm256_mul_ps(_mm256_fmadd_ps(c, boxCenter, columnSum), boxScale);
+
+            __m256 pick = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)(nearMask + j)));
+            _mm256_storeu_ps(out + j, _mm256_blendv_ps(box, cross, pick));
+        }
+        for (; j < b; ++j) out[j] = smoothPoint(row, nearMask, j);
+    }
+#endif
+};
@@ -0,0 +1,339 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include "shader.h"
+#ifdef __APPLE__
+    #include <OpenGL/glu.h>
+#else
+    #include <GL/glu.h>
+#endif
+
+// one quadric for every gluSphere call; GLU allocates a new one on the heap
+static inline GLUquadric* sharedQuadric() {
+    static GLUquadric* quad = gluNewQuadric();
+    return quad;
+}
+
+// Instanced spheres. Each tessellation level is one unit sphere, laid out
+// like gluSphere's (slices around z, stacks from pole to pole), kept in a
+// static vertex and index buffer; a unit position doubles as the normal.
+// Callers queue instances (centre, radius, colour) per level and draw()
+// streams them all into one orphaned buffer and issues one
+// glDrawElementsInstanced per level, so a frame's bodies, halos or
+// supernova shells cost one upload and a handful of draws however many
+// there are.
+//
+// The tessellation of each sphere follows its projected radius in pixels:
+// small or distant spheres drop to 8 slices and, below a few pixels, to an
+// impostor, a camera-facing quad cut to a disc in the fragment shader. Each
+// sphere remembers its level under a caller-chosen key and only changes it
+// once the radius has moved well past the boundary, so spheres drifting
+// across a threshold do not flicker between levels.
+//
+// Lit batches reproduce the fixed-function vertex lighting of GL_LIGHT0
+// with the colour as ambient and diffuse material, the way GL_COLOR_MATERIAL
+// is set up, so instanced bodies look like the gluSphere ones. Without
+// instanced arrays (GL 3.3 or the two ARB extensions) every instance falls
+// back to gluSphere with the same colour, impostors as coarse spheres.
+
+class SphereRenderer {
+public:
+    SphereRenderer() = default;
+    SphereRenderer(const SphereRenderer&) = delete;
+    SphereRenderer& operator=(const SphereRenderer&) = delete;
+
+    struct Instance {
+        float x, y, z, radius;
+        float r, g, b, a;
+    };
+
+    // projected radius thresholds in pixels between the detail levels, and
+    // how far past one the radius must get before a sphere changes level
+    static const int kLodLevels = 5;
+    static constexpr int kLodDetail[kLodLevels] = {0, 8, 12, 16, 24};        // 0 is the impostor
+    static constexpr float kLodEdges[kLodLevels - 1] = {2.5f, 8.0f, 20.0f, 50.0f};
+    static constexpr float kLodHysteresis = 1.2f;
+
+    // camera position and the pixels one unit covers at unit distance
+    void setView(float x, float y, float z, float pixelsPerUnit) {
+        viewX = x; viewY = y; viewZ = z;
+        viewScale = pixelsPerUnit;
+    }
+
+    // Queues a sphere with at most maxDetail slices and stacks. lodKey names
+    // the sphere across frames for the hysteresis; keys should be small and
+    // dense since the level per key is kept in an array.
+    void add(uint32_t lodKey, int maxDetail, float x, float y, float z, float radius,
+             float r, float g, float b, float a) {
+        int detail = std::min(kLodDetail[selectLevel(lodKey, x, y, z, radius)], maxDetail);
+        levelFor(detail).instances.push_back(Instance{x, y, z, radius, r, g, b, a});
+    }
+
+    size_t queued() const {
+        size_t count = 0;
+        for (const Level& level : levels) count += level.instances.size();
+        return count;
+    }
+
+    // Draws and clears everything queued and returns the draw calls that
+    // took. lit should match GL_LIGHTING, which the fallback path relies on;
+    // blending and depth state are the caller's.
+    int draw(bool lit) {
+        size_t total = queued();
+        if (total == 0) return 0;
+        if (!ensureProgram()) {
+            drawImmediate();
+            return (int)total;
+        }
+
+        // all levels share one stream, each reads its own range
+        const GLsizeiptr bytes = (GLsizeiptr)(total * sizeof(Instance));
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        if (bytes > instanceCapacity) instanceCapacity = bytes;
+        glBufferData(GL_ARRAY_BUFFER, instanceCapacity, nullptr, GL_STREAM_DRAW);
+        size_t first = 0;
+        for (Level& level : levels) {
+            if (level.instances.empty()) continue;
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(first * sizeof(Instance)),
+                            (GLsizeiptr)(level.instances.size() * sizeof(Instance)), level.instances.data());
+            first += level.instances.size();
+        }
+
+        glUseProgram(program);
+        glUniform1i(uLit, lit ? 1 : 0);
+        GLint impostor = -1;
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        vertexAttribDivisor(1, 1);
+        vertexAttribDivisor(2, 1);
+
+        first = 0;
+        int draws = 0;
+        for (Level& level : levels) {
+            if (level.instances.empty()) continue;
+            if (!level.vertexBuffer) buildMesh(level);
+            if (impostor != (level.detail == 0)) {
+                impostor = level.detail == 0;
+                glUniform1i(uImpostor, impostor);
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, level.vertexBuffer);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            const char* base = (const char*)(first * sizeof(Instance));
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), base);
+            glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), base + 4 * sizeof(float));
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.indexBuffer);
+            drawElementsInstanced(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_SHORT, nullptr,
+                                  (GLsizei)level.instances.size());
+            ++draws;
+            first += level.instances.size();
+            level.instances.clear();
+        }
+
+        vertexAttribDivisor(1, 0);
+        vertexAttribDivisor(2, 0);
+        glDisableVertexAttribArray(0);
+        glDisableVertexAttribArray(1);
+        glDisableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+        return draws;
+    }
+
+    // must run while the context is still current
+    void destroy() {
+        for (Level& level : levels) {
+            if (level.vertexBuffer) glDeleteBuffers(1, &level.vertexBuffer);
+            if (level.indexBuffer) glDeleteBuffers(1, &level.indexBuffer);
+            level.vertexBuffer = level.indexBuffer = 0;
+        }
+        if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+        if (program) glDeleteProgram(program);
+        instanceBuffer = program = 0;
+        instanceCapacity = 0;
+    }
+
+private:
+    struct Level {
+        int detail;
+        GLuint vertexBuffer = 0, indexBuffer = 0;
+        GLsizei indexCount = 0;
+        std::vector<Instance> instances;
+    };
+
+    int selectLevel(uint32_t key, float x, float y, float z, float radius) {
+        float dx = x - viewX, dy = y - viewY, dz = z - viewZ;
+        float distance = std::sqrt(dx*dx + dy*dy + dz*dz);
+        float pixels = distance > radius ? radius * viewScale / distance : 1e9f;
+
+        if (key >= lodLevels.size()) lodLevels.resize(key + 1, 0);
+        int level = lodLevels[key] - 1;
+        if (level < 0) {
+            // first sight: no history to hold on to
+            level = 0;
+            while (level + 1 < kLodLevels && pixels > kLodEdges[level]) ++level;
+        } else {
+            while (level + 1 < kLodLevels && pixels > kLodEdges[level] * kLodHysteresis) ++level;
+            while (level > 0 && pixels < kLodEdges[level - 1] / kLodHysteresis) --level;
+        }
+        lodLevels[key] = (uint8_t)(level + 1);
+        return level;
+    }
+
+    // few levels are ever used, so a linear search beats a map
+    Level& levelFor(int detail) {
+        for (Level& level : levels) {
+            if (level.detail == detail) return level;
+        }
+        levels.push_back(Level());
+        levels.back().detail = detail;
+        return levels.back();
+    }
+
+    bool ensureProgram() {
+        if (program) return true;
+        if (programFailed) return false;
+        if (GLEW_VERSION_3_3) {
+            vertexAttribDivisor = glVertexAttribDivisor;
+            drawElementsInstanced = glDrawElementsInstanced;
+        } else if (GLEW_ARB_instanced_arrays && GLEW_ARB_draw_instanced) {
+            vertexAttribDivisor = glVertexAttribDivisorARB;
+            drawElementsInstanced = glDrawElementsInstancedARB;
+        }
+        if (!vertexAttribDivisor || !drawElementsInstanced ||
+            !(program = buildProgram("sphere", kVertexShader, kFragmentShader, {"unitPos", "centerRadius", "color"}))) {
+            programFailed = true;
+            return false;
+        }
+        uLit = glGetUniformLocation(program, "lit");
+        uImpostor = glGetUniformLocation(program, "impostor");
+        glGenBuffers(1, &instanceBuffer);
+        return true;
+    }
+
+    void buildMesh(Level& level) {
+        if (level.detail == 0) {
+            // impostor quad, corners in the unit square
+            const float corners[] = {-1.0f, -1.0f, 0.0f,  1.0f, -1.0f, 0.0f,  1.0f, 1.0f, 0.0f,  -1.0f, 1.0f, 0.0f};
+            const uint16_t quad[] = {0, 1, 2, 0, 2, 3};
+            level.indexCount = 6;
+            glGenBuffers(1, &level.vertexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, level.vertexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+            glGenBuffers(1, &level.indexBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.indexBuffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+            return;
+        }
+        const int slices = level.detail, stacks = level.detail;
+        std::vector<float> positions;
+        positions.reserve((size_t)(stacks + 1) * (slices + 1) * 3);
+        for (int i = 0; i <= stacks; ++i) {
+            float phi = (float)i * 3.14159265f / (float)stacks;
+            for (int j = 0; j <= slices; ++j) {
+                float theta = (float)j * 2.0f * 3.14159265f / (float)slices;
+                positions.push_back(std::sin(phi) * std::cos(theta));
+                positions.push_back(std::sin(phi) * std::sin(theta));
+                positions.push_back(std::cos(phi));
+            }
+        }
+
+        // two counter-clockwise triangles per quad, seen from outside
+        std::vector<uint16_t> indices;
+        indices.reserve((size_t)stacks * slices * 6);
+        for (int i = 0; i < stacks; ++i) {
+            for (int j = 0; j < slices; ++j) {
+                uint16_t a = (uint16_t)(i * (slices + 1) + j), b = (uint16_t)(a + slices + 1);
+                indices.insert(indices.end(), {a, b, (uint16_t)(a + 1), (uint16_t)(a + 1), b, (uint16_t)(b + 1)});
+            }
+        }
+        level.indexCount = (GLsizei)indices.size();
+
+        glGenBuffers(1, &level.vertexBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, level.vertexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &level.indexBuffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, level.indexBuffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+    }
+
+    void drawImmediate() {
+        for (Level& level : levels) {
+            for (const Instance& s : level.instances) {
+                glPushMatrix();
+                glTranslatef(s.x, s.y, s.z);
+                glColor4f(s.r, s.g, s.b, s.a);
+                int detail = level.detail > 0 ? level.detail : kImpostorFallbackDetail;
+                gluSphere(sharedQuadric(), s.radius, detail, detail);
+                glPopMatrix();
+            }
+            level.instances.clear();
+        }
+    }
+
+    static const int kImpostorFallbackDetail = 6;
+
+    // The fixed-function terms of GL_LIGHT0 with no specular, attenuation or
+    // spot. An impostor is a few pixels across, so it is shaded flat as the
+    // point of the sphere facing the camera.
+    static constexpr const char* kVertexShader = R"(
+        #version 120
+        attribute vec3 unitPos;
+        attribute vec4 centerRadius;
+        attribute vec4 color;
+        uniform bool lit, impostor;
+        varying vec4 shade;
+        varying vec2 corner;
+
+        void main() {
+            vec4 eye;
+            vec3 n;
+            if (impostor) {
+                eye = gl_ModelViewMatrix * vec4(centerRadius.xyz, 1.0);
+                eye.xy += unitPos.xy * centerRadius.w;
+                n = vec3(0.0, 0.0, 1.0);
+            } else {
+                eye = gl_ModelViewMatrix * vec4(centerRadius.xyz + unitPos * centerRadius.w, 1.0);
+                n = normalize(gl_NormalMatrix * unitPos);
+            }
+            corner = unitPos.xy;
+            shade = color;
+            if (lit) {
+                vec3 l = normalize(gl_LightSource[0].position.xyz - eye.xyz * gl_LightSource[0].position.w);
+                vec3 light = gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb +
+                             max(dot(n, l), 0.0) * gl_LightSource[0].diffuse.rgb;
+                shade.rgb = clamp(color.rgb * light, 0.0, 1.0);
+            }
+            gl_Position = gl_ProjectionMatrix * eye;
+        }
+    )";
+
+    static constexpr const char* kFragmentShader = R"(
+        #version 120
+        uniform bool impostor;
+        varying vec4 shade;
+        varying vec2 corner;
+        void main() {
+            if (impostor && dot(corner, corner) > 1.0) discard;
+            gl_FragColor = shade;
+        }
+    )";
+
+    std::vector<Level> levels;
+    GLuint program = 0, instanceBuffer = 0;
+    GLsizeiptr instanceCapacity = 0;
+    GLint uLit = -1, uImpostor = -1;
+    std::vector<uint8_t> lodLevels;          // per key, level + 1, 0 before first use
+    float viewX = 0.0f, viewY = 0.0f, viewZ = 0.0f, viewScale = 1.0f;
+    bool programFailed = false;
+    PFNGLVERTEXATTRIBDIVISORPROC vertexAttribDivisor = nullptr;
+    PFNGLDRAWELEMENTSINSTANCEDPROC drawElementsInstanced = nullptr;
+};
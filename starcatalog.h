@@ -0,0 +1,237 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <iostream>
+#include "threadpool.h"
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2,
+// 3"): a counter-based generator, so the numbers for star i depend only on
+// (seed, i) and any thread can produce them in any order.
+struct Philox4x32 {
+    uint32_t v[4];
+
+    Philox4x32(uint64_t seed, uint64_t index, uint32_t stream) {
+        uint32_t counter[4] = {(uint32_t)index, (uint32_t)(index >> 32), stream, 0};
+        uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = (uint64_t)0xD2511F53u * counter[0];
+            uint64_t p1 = (uint64_t)0xCD9E8D57u * counter[2];
+            uint32_t next[4] = {(uint32_t)(p1 >> 32) ^ counter[1] ^ key[0], (uint32_t)p1,
+                                (uint32_t)(p0 >> 32) ^ counter[3] ^ key[1], (uint32_t)p0};
+            std::memcpy(counter, next, sizeof(counter));
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+        std::memcpy(v, counter, sizeof(v));
+    }
+
+    // k-th output as a float in [0, 1)
+    float uniform(int k) const { return (float)(v[k] >> 8) * (1.0f / 16777216.0f); }
+};
+
+// The background star catalogue as structure-of-arrays: position,
+// brightness, twinkle rate and colour class (0 white, 1 blue-white,
+// 2 orange, stored as float so the arrays upload as they are).
+//
+// generate() fills the arrays tile by tile on the pool; every star draws
+// its numbers from Philox keyed by the seed and its index, so the result
+// is bit-identical for any thread count. save() writes a header and the
+// six arrays back to back, and load() maps such a file read-only and
+// points the arrays straight into it, so a large catalogue costs one mmap
+// at startup instead of its generation.
+
+class StarCatalog {
+public:
+    static const int kArrays = 6;
+
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    const float* brightness = nullptr;
+    const float* twinkleRate = nullptr;
+    const float* starClass = nullptr;
+
+    StarCatalog() = default;
+    ~StarCatalog() { release(); }
+    StarCatalog(const StarCatalog&) = delete;
+    StarCatalog& operator=(const StarCatalog&) = delete;
+
+    size_t size() const { return count; }
+    uint64_t seed() const { return catalogSeed; }
+    bool mapped() const { return mapping != nullptr; }
+
+    void generate(size_t starCount, uint64_t seed, ThreadPool* pool) {
+        release();
+        storage.resize(starCount * kArrays);
+        count = starCount;
+        catalogSeed = seed;
+        point(storage.data());
+
+        float* out = storage.data();
+        forEachTile(pool, starCount, 16384, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Philox4x32 a(seed, i, 0), b(seed, i, 1);
+                float distance = 800.0f + 1000.0f * a.uniform(0);
+                float theta = a.uniform(1) * 2.0f * 3.14159f;
+                float phi = a.uniform(2) * 3.14159f;
+                float tint = b.uniform(1);
+
+                out[0 * starCount + i] = distance * sinf(phi) * cosf(theta);
+                out[1 * starCount + i] = distance * sinf(phi) * sinf(theta);
+                out[2 * starCount + i] = distance * cosf(phi);
+                out[3 * starCount + i] = powf(a.uniform(3), 1.8f);
+                out[4 * starCount + i] = 2.0f + 20.0f * b.uniform(0);
+                out[5 * starCount + i] = tint < 0.8f ? 0.0f : tint < 0.9f ? 1.0f : 2.0f;
+            }
+        });
+    }
+
+    bool save(const char* path) const {
+        std::string temporary = std::string(path) + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "wb");
+        if (!file) {
+            std::cerr << "Cannot write star cache " << temporary << "\n";
+            return false;
+        }
+        Header header = makeHeader(count, catalogSeed);
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        const float* arrays[kArrays] = {x, y, z, brightness, twinkleRate, starClass};
+        for (int k = 0; k < kArrays && ok; ++k) {
+            ok = count == 0 || std::fwrite(arrays[k], sizeof(float), count, file) == count;
+        }
+        ok = std::fclose(file) == 0 && ok;
+        std::remove(path);
+        if (!ok || std::rename(temporary.c_str(), path) != 0) {
+            std::cerr << "Failed to write star cache " << path << "\n";
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // maps a cache written by save() for the same count and seed; false
+    // when there is none or it does not match
+    bool load(const char* path, size_t starCount, uint64_t seed) {
+        release();
+        const size_t bytes = sizeof(Header) + starCount * kArrays * sizeof(float);
+        const void* data = mapFile(path, bytes);
+        if (!data) return false;
+
+        Header expected = makeHeader(starCount, seed);
+        if (std::memcmp(data, &expected, sizeof(Header)) != 0) {
+            release();
+            return false;
+        }
+        count = starCount;
+        catalogSeed = seed;
+        point((const float*)((const char*)data + sizeof(Header)));
+        return true;
+    }
+
+    // the cached catalogue when it matches, otherwise a fresh one that is
+    // then written back for the next start
+    void loadOrGenerate(const char* path, size_t starCount, uint64_t seed, ThreadPool* pool) {
+        if (load(path, starCount, seed)) return;
+        generate(starCount, seed, pool);
+        save(path);
+    }
+
+private:
+    // 64 bytes so the arrays after it stay cache-line aligned in the mapping
+    struct Header {
+        char magic[8];
+        uint32_t version, arrays;
+        uint64_t count, seed;
+        uint32_t floatBytes, pad[7];
+    };
+    static_assert(sizeof(Header) == 64, "star cache header layout");
+
+    std::vector<float> storage;
+    size_t count = 0;
+    uint64_t catalogSeed = 0;
+    const void* mapping = nullptr;
+    size_t mappingBytes = 0;
+#ifdef _WIN32
+    HANDLE fileHandle = INVALID_HANDLE_VALUE, mapHandle = nullptr;
+#endif
+
+    static Header makeHeader(size_t starCount, uint64_t seed) {
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "GSTARCAT", 8);
+        header.version = 1;
+        header.arrays = kArrays;
+        header.count = starCount;
+        header.seed = seed;
+        header.floatBytes = sizeof(float);
+        return header;
+    }
+
+    void point(const float* base) {
+        const float** arrays[kArrays] = {&x, &y, &z, &brightness, &twinkleRate, &starClass};
+        for (int k = 0; k < kArrays; ++k) *arrays[k] = base + (size_t)k * count;
+    }
+
+    // read-only mapping of exactly `bytes`, or nullptr when the file is missing or another size
+    const void* mapFile(const char* path, size_t bytes) {
+#ifdef _WIN32
+        fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (fileHandle == INVALID_HANDLE_VALUE) return nullptr;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(fileHandle, &size) || (uint64_t)size.QuadPart != bytes) {
+            release();
+            return nullptr;
+        }
+        mapHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        mapping = mapHandle ? MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+#else
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (uint64_t)info.st_size != bytes) {
+            close(fd);
+            return nullptr;
+        }
+        void* view = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        mapping = view == MAP_FAILED ? nullptr : view;
+#endif
+        mappingBytes = bytes;
+        if (!mapping) release();
+        return mapping;
+    }
+
+    void release() {
+#ifdef _WIN32
+        if (mapping) UnmapViewOfFile(mapping);
+        if (mapHandle) CloseHandle(mapHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+        mapHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (mapping) munmap(const_cast<void*>(mapping), mappingBytes);
+#endif
+        mapping = nullptr;
+        mappingBytes = 0;
+        storage.clear();
+        storage.shrink_to_fit();
+        count = 0;
+        point(nullptr);
+    }
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <GL/glew.h>
+#include <cmath>
+#include <cstddef>
+#include "shader.h"
+#include "starcatalog.h"
+
+// The background stars as one static vertex buffer. The catalogue's six
+// arrays go up once, back to back, straight from its storage or mapped
+// cache file; each frame sets the time uniform and issues a single
+// glDrawArrays, and the vertex shader does the twinkle and tint the old
+// per-star loop did. Ten million stars cost the CPU what two thousand do.
+// Without shaders the catalogue is drawn in immediate mode.
+
+class StarField {
+public:
+    StarField() = default;
+    StarField(const StarField&) = delete;
+    StarField& operator=(const StarField&) = delete;
+
+    // the catalogue must outlive the star field
+    void init(const StarCatalog& stars) {
+        catalog = &stars;
+        uploaded = false;
+    }
+
+    // returns the draw calls, one either way
+    int draw(float time) {
+        if (!catalog || catalog->size() == 0) return 0;
+        glPointSize(1.0f);
+        if (!ensureProgram()) {
+            drawImmediate(time);
+            return 1;
+        }
+        const size_t n = catalog->size();
+        const float* arrays[StarCatalog::kArrays] = {catalog->x, catalog->y, catalog->z, catalog->brightness,
+                                                     catalog->twinkleRate, catalog->starClass};
+        const GLsizeiptr arrayBytes = (GLsizeiptr)(n * sizeof(float));
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (!uploaded) {
+            glBufferData(GL_ARRAY_BUFFER, arrayBytes * StarCatalog::kArrays, nullptr, GL_STATIC_DRAW);
+            for (int k = 0; k < StarCatalog::kArrays; ++k) {
+                glBufferSubData(GL_ARRAY_BUFFER, k * arrayBytes, arrayBytes, arrays[k]);
+            }
+            uploaded = true;
+        }
+
+        glUseProgram(program);
+        glUniform1f(uTime, time);
+        for (int k = 0; k < StarCatalog::kArrays; ++k) {
+            glEnableVertexAttribArray(k);
+            glVertexAttribPointer(k, 1, GL_FLOAT, GL_FALSE, 0, (const void*)(k * arrayBytes));
+        }
+        glDrawArrays(GL_POINTS, 0, (GLsizei)n);
+        for (int k = 0; k < StarCatalog::kArrays; ++k) glDisableVertexAttribArray(k);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+        return 1;
+    }
+
+    // must run while the context is still current
+    void destroy() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+        if (program) glDeleteProgram(program);
+        buffer = program = 0;
+        uploaded = false;
+    }
+
+private:
+    const StarCatalog* catalog = nullptr;
+    GLuint program = 0, buffer = 0;
+    bool programFailed = false, uploaded = false;
+    GLint uTime = -1;
+
+    bool ensureProgram() {
+        if (program) return true;
+        if (programFailed) return false;
+        program = buildProgram("star field", kVertexShader, kFragmentShader,
+                               {"x", "y", "z", "brightness", "twinkleRate", "starClass"});
+        if (!program) {
+            programFailed = true;
+            return false;
+        }
+        uTime = glGetUniformLocation(program, "time");
+        glGenBuffers(1, &buffer);
+        return true;
+    }
+
+    void drawImmediate(float time) const {
+        const StarCatalog& s = *catalog;
+        glBegin(GL_POINTS);
+        for (size_t i = 0; i < s.size(); ++i) {
+            float b = s.brightness[i] * 1.15f * (0.6f + 0.4f * sinf(time * s.twinkleRate[i]));
+            if (s.starClass[i] < 0.5f) glColor4f(b, b, b, b);
+            else if (s.starClass[i] < 1.5f) glColor4f(b * 0.8f, b * 0.9f, b, b);
+            else glColor4f(b, b * 0.7f, b * 0.4f, b);
+            glVertex3f(s.x[i], s.y[i], s.z[i]);
+        }
+        glEnd();
+    }
+
+    static constexpr const char* kVertexShader = R"(
+        #version 120
+        attribute float x, y, z, brightness, twinkleRate, starClass;
+        uniform float time;
+        varying vec4 color;
+
+        void main() {
+            float b = brightness * 1.15 * (0.6 + 0.4 * sin(time * twinkleRate));
+            vec3 tint = starClass < 0.5 ? vec3(1.0) : starClass < 1.5 ? vec3(0.8, 0.9, 1.0) : vec3(1.0, 0.7, 0.4);
+            color = vec4(b * tint, b);
+            gl_Position = gl_ModelViewProjectionMatrix * vec4(x, y, z, 1.0);
+        }
+    )";
+
+    static constexpr const char* kFragmentShader = R"(
+        #version 120
+        varying vec4 color;
+        void main() { gl_FragColor = color; }
+    )";
+};
@@ -0,0 +1,184 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <random>
+#include "../gravity.h"
+
+// Shared pieces of the tests and benchmarks: a random cluster of bodies
+// held as the GravitySystem arrays, the error of one acceleration set
+// against another, a best-of-N wall clock timer, and a small integrable
+// store with its energy for the integrator checks.
+
+struct Cluster {
+    std::vector<float> x, y, z, mass;
+    std::vector<float> ax, ay, az;
+
+    // uniform ball of the given radius, masses in [0.5, 1.5), fixed seed
+    Cluster(size_t count, float radius = 100.0f, uint32_t seed = 1) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> weight(0.5f, 1.5f);
+        for (size_t i = 0; i < count; ++i) {
+            float px, py, pz;
+            do {
+                px = unit(rng); py = unit(rng); pz = unit(rng);
+            } while (px*px + py*py + pz*pz > 1.0f);
+            x.push_back(px * radius); y.push_back(py * radius); z.push_back(pz * radius);
+            mass.push_back(weight(rng));
+        }
+        ax.assign(count, 0.0f); ay.assign(count, 0.0f); az.assign(count, 0.0f);
+    }
+
+    GravitySystem system() {
+        return GravitySystem{x.data(), y.data(), z.data(), mass.data(),
+                             ax.data(), ay.data(), az.data(), x.size(), nullptr, 0};
+    }
+};
+
+struct Accelerations {
+    std::vector<float> x, y, z;
+};
+
+static inline Accelerations accelerationsOf(const Cluster& cluster) {
+    return Accelerations{cluster.ax, cluster.ay, cluster.az};
+}
+
+// RMS of |a - reference| over RMS of |reference|
+static inline double relativeError(const Cluster& cluster, const Accelerations& reference) {
+    double error = 0.0, norm = 0.0;
+    for (size_t i = 0; i < reference.x.size(); ++i) {
+        double dx = cluster.ax[i] - reference.x[i];
+        double dy = cluster.ay[i] - reference.y[i];
+        double dz = cluster.az[i] - reference.z[i];
+        error += dx*dx + dy*dy + dz*dz;
+        norm += (double)reference.x[i] * reference.x[i] + (double)reference.y[i] * reference.y[i] +
+                (double)reference.z[i] * reference.z[i];
+    }
+    return norm > 0.0 ? std::sqrt(error / norm) : 0.0;
+}
+
+// largest per-body |a - reference| / |reference|
+static inline double worstError(const Cluster& cluster, const Accelerations& reference) {
+    double worst = 0.0;
+    for (size_t i = 0; i < reference.x.size(); ++i) {
+        double dx = cluster.ax[i] - reference.x[i];
+        double dy = cluster.ay[i] - reference.y[i];
+        double dz = cluster.az[i] - reference.z[i];
+        double r = std::sqrt((double)reference.x[i] * reference.x[i] + (double)reference.y[i] * reference.y[i] +
+                             (double)reference.z[i] * reference.z[i]);
+        if (r > 0.0) worst = std::max(worst, std::sqrt(dx*dx + dy*dy + dz*dz) / r);
+    }
+    return worst;
+}
+
+// fastest of `repeats` runs, in milliseconds
+template <typename Fn>
+static double bestMilliseconds(int repeats, const Fn& fn) {
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// accelerations of `samples` evenly spaced bodies, summed in double, to
+// measure errors below float round-off
+struct ExactSample {
+    std::vector<size_t> index;
+    std::vector<double> x, y, z;
+};
+
+static inline ExactSample exactSample(const Cluster& cluster, const GravityParams& params, size_t samples) {
+    ExactSample exact;
+    const size_t n = cluster.x.size();
+    const double eps2 = (double)params.softening * params.softening;
+    samples = std::min(samples, n);
+    for (size_t s = 0; s < samples; ++s) {
+        size_t i = s * n / samples;
+        double ax = 0.0, ay = 0.0, az = 0.0;
+        for (size_t j = 0; j < n; ++j) {
+            double dx = (double)cluster.x[j] - cluster.x[i];
+            double dy = (double)cluster.y[j] - cluster.y[i];
+            double dz = (double)cluster.z[j] - cluster.z[i];
+            double r2 = dx*dx + dy*dy + dz*dz + eps2;
+            if (r2 <= 0.0) continue;
+            double invR = 1.0 / std::sqrt(r2);
+            double w = cluster.mass[j] * invR * invR * invR;
+            ax += dx * w; ay += dy * w; az += dz * w;
+        }
+        exact.index.push_back(i);
+        exact.x.push_back(params.G * ax); exact.y.push_back(params.G * ay); exact.z.push_back(params.G * az);
+    }
+    return exact;
+}
+
+// RMS of |a - exact| over RMS of |exact| on the sampled bodies
+static inline double sampledError(const Cluster& cluster, const ExactSample& exact) {
+    double error = 0.0, norm = 0.0;
+    for (size_t s = 0; s < exact.index.size(); ++s) {
+        size_t i = exact.index[s];
+        double dx = cluster.ax[i] - exact.x[s];
+        double dy = cluster.ay[i] - exact.y[s];
+        double dz = cluster.az[i] - exact.z[s];
+        error += dx*dx + dy*dy + dz*dz;
+        norm += exact.x[s] * exact.x[s] + exact.y[s] * exact.y[s] + exact.z[s] * exact.z[s];
+    }
+    return norm > 0.0 ? std::sqrt(error / norm) : 0.0;
+}
+
+// the simulator's defaults (assets.h)
+static const float kDt = 1.0f / 120.0f;
+static const float kGravity = 200.0f;
+static const float kSoftening = 0.5f;
+static const int kMaxPhysicsSubsteps = 64;
+static const float kBlockMaxStep = 1.0f;
+static const float kBlockEta = 0.02f;
+
+struct Planets {
+    std::vector<float> x, y, z, vx, vy, vz, ax, ay, az, mass;
+
+    size_t size() const { return x.size(); }
+
+    void kick(float dt) {
+        for (size_t i = 0; i < size(); ++i) {
+            vx[i] += ax[i] * dt; vy[i] += ay[i] * dt; vz[i] += az[i] * dt;
+        }
+    }
+
+    void drift(float dt) {
+        for (size_t i = 0; i < size(); ++i) {
+            x[i] += vx[i] * dt; y[i] += vy[i] * dt; z[i] += vz[i] * dt;
+        }
+    }
+
+    void add(float px, float py, float pz, float qx, float qy, float qz, float m) {
+        x.push_back(px); y.push_back(py); z.push_back(pz);
+        vx.push_back(qx); vy.push_back(qy); vz.push_back(qz);
+        ax.push_back(0.0f); ay.push_back(0.0f); az.push_back(0.0f);
+        mass.push_back(m);
+    }
+
+    GravitySystem system() {
+        return GravitySystem{x.data(), y.data(), z.data(), mass.data(), ax.data(), ay.data(), az.data(),
+                             size(), nullptr, 0};
+    }
+
+    double energy() const {
+        const double eps2 = (double)kSoftening * kSoftening;
+        double e = 0.0;
+        for (size_t i = 0; i < size(); ++i) {
+            e += 0.5 * mass[i] * ((double)vx[i] * vx[i] + (double)vy[i] * vy[i] + (double)vz[i] * vz[i]);
+            for (size_t j = i + 1; j < size(); ++j) {
+                double dx = (double)x[j] - x[i], dy = (double)y[j] - y[i], dz = (double)z[j] - z[i];
+                e -= kGravity * mass[i] * mass[j] / std::sqrt(dx*dx + dy*dy + dz*dz + eps2);
+            }
+        }
+        return e;
+    }
+};
@@ -0,0 +1,34 @@
+// Barnes-Hut at the sizes it is meant for: tree build plus accelerations
+// for a range of opening angles against one direct sum, with the error on
+// sampled bodies summed exactly in double.
+//   ./bench_barneshut [bodies]     default 100000
+#include "bench.h"
+#include <cstdlib>
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 100000;
+    const float thetas[] = {0.2f, 0.35f, 0.5f, 0.7f, 1.0f};
+    if (count == 0) {
+        std::cerr << "usage: bench_barneshut [bodies]\n";
+        return 1;
+    }
+
+    Cluster cluster(count);
+    GravitySystem sys = cluster.system();
+    ThreadPool pool;
+    GravityParams params = {1.0f, 0.5f, 0.0f};
+    const ExactSample exact = exactSample(cluster, params, 1000);
+
+    double direct = bestMilliseconds(1, [&] { computeGravityDirect(sys, params, &pool); });
+    std::printf("%zu bodies, %u threads, direct sum %.1f ms, rms error %.3e\n", count, pool.size(), direct,
+                sampledError(cluster, exact));
+    std::printf("%7s %10s %10s %12s\n", "theta", "ms", "speedup", "rms error");
+
+    Octree tree;
+    for (float theta : thetas) {
+        params.theta = theta;
+        double ms = bestMilliseconds(2, [&] { computeGravityBarnesHut(sys, params, tree, &pool); });
+        std::printf("%7.2f %10.1f %9.1fx %12.3e\n", theta, ms, direct / ms, sampledError(cluster, exact));
+    }
+    return 0;
+}
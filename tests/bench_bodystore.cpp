@@ -0,0 +1,78 @@
+// Body layout: one integrate pass and one curvature-style read pass over
+// the same bodies, held as the array-of-structs std::vector<Body> the 3D
+// simulator used to keep and as the structure-of-arrays BodyStore.
+//   ./bench_bodystore [bodies]     default 100000
+#include "bench.h"
+#include <cstdlib>
+#include "../bodies.h"
+
+// a few grid points, each summing every body's pull as the curvature field does
+static const int kProbes = 16;
+
+static float probeX(int p) { return (p % 4 - 1.5f) * 40.0f; }
+static float probeY(int p) { return (p / 4 - 1.5f) * 40.0f; }
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 100000;
+    if (count == 0) {
+        std::cerr << "usage: bench_bodystore [bodies]\n";
+        return 1;
+    }
+
+    Cluster cluster(count, 1000.0f);
+    std::vector<Body> aos;
+    std::vector<vec3d> aosAcc;
+    BodyStore soa;
+    soa.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        Body b(vec3d(cluster.x[i], cluster.y[i], cluster.z[i]), vec3d(0.1f, -0.2f, 0.05f), cluster.mass[i],
+               1.0f + cluster.mass[i], vec3d(1.0f, 1.0f, 1.0f));
+        aos.push_back(b);
+        soa.push_back(b);
+        aosAcc.push_back(vec3d(1e-3f, 2e-3f, -1e-3f));
+        soa.ax[i] = 1e-3f; soa.ay[i] = 2e-3f; soa.az[i] = -1e-3f;
+    }
+
+    const float dt = 1e-4f, baseZ = 15.0f, softening = 0.25f;
+    const int repeats = 50;
+    float sink = 0.0f;      // keeps the read passes from being optimized out
+
+    double aosIntegrate = bestMilliseconds(repeats, [&] {
+        // kick then drift, as BodyStore::kick and drift
+        for (size_t i = 0; i < aos.size(); ++i) aos[i].vel += aosAcc[i] * dt;
+        for (size_t i = 0; i < aos.size(); ++i) aos[i].pos += aos[i].vel * dt;
+    });
+    double soaIntegrate = bestMilliseconds(repeats, [&] {
+        soa.kick(dt);
+        soa.drift(dt);
+    });
+
+    double aosRead = bestMilliseconds(repeats, [&] {
+        for (int p = 0; p < kProbes; ++p) {
+            float px = probeX(p), py = probeY(p), sum = 0.0f;
+            for (const Body& b : aos) {
+                float dx = b.pos.x - px, dy = b.pos.y - py, dz = b.pos.z - baseZ;
+                sum += b.mass / (dx*dx + dy*dy + dz*dz + softening);
+            }
+            sink += sum;
+        }
+    });
+    double soaRead = bestMilliseconds(repeats, [&] {
+        for (int p = 0; p < kProbes; ++p) {
+            float px = probeX(p), py = probeY(p), sum = 0.0f;
+            for (size_t i = 0; i < soa.size(); ++i) {
+                float dx = soa.x[i] - px, dy = soa.y[i] - py, dz = soa.z[i] - baseZ;
+                sum += soa.mass[i] / (dx*dx + dy*dy + dz*dz + softening);
+            }
+            sink += sum;
+        }
+    });
+
+    std::printf("%zu bodies, sizeof(Body) %zu bytes\n", count, sizeof(Body));
+    std::printf("%22s %14s %14s %9s\n", "pass", "vector<Body>", "BodyStore", "speedup");
+    std::printf("%22s %11.3f ms %11.3f ms %8.2fx\n", "integrate", aosIntegrate, soaIntegrate,
+                aosIntegrate / soaIntegrate);
+    std::printf("%22s %11.3f ms %11.3f ms %8.2fx\n", "curvature (16 points)", aosRead, soaRead, aosRead / soaRead);
+    std::printf("checksum %g\n", (double)sink);
+    return 0;
+}
@@ -0,0 +1,66 @@
+// FMM, Barnes-Hut and direct summation at equal error. Each solver is run
+// over its accuracy knob (FMM expansion order at kFmmTheta, Barnes-Hut
+// opening angle), every setting is measured against a double-precision
+// direct sum, and for each error target the fastest setting that meets it
+// is reported next to the float direct sum.
+#include "bench.h"
+#include "../fmm.h"
+
+struct Setting {
+    double knob, ms, error;
+};
+
+// fastest setting within `target`, nullptr when none is
+static const Setting* fastestWithin(const std::vector<Setting>& settings, double target) {
+    const Setting* best = nullptr;
+    for (const Setting& s : settings) {
+        if (s.error <= target && (!best || s.ms < best->ms)) best = &s;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 20000;
+    const double targets[] = {1e-3, 1e-4, 1e-5, 1e-6};
+    const float thetas[] = {1.0f, 0.7f, 0.5f, 0.35f, 0.25f, 0.18f, 0.12f, 0.08f};
+    const int orders[] = {2, 3, 4, 5, 6, 7, 8, 10};
+
+    Cluster cluster(count);
+    GravitySystem sys = cluster.system();
+    ThreadPool pool;
+    GravityParams params = {1.0f, 0.5f, 0.0f};
+    ExactSample exact = exactSample(cluster, params, 1000);
+    std::printf("%zu bodies, %u threads, %s kernels\n", count, pool.size(), simdLevelName(simdLevel()));
+
+    double directMs = bestMilliseconds(3, [&] { computeGravityDirect(sys, params, &pool); });
+    double directError = sampledError(cluster, exact);
+
+    std::vector<Setting> tree, fmm;
+    Octree octree;
+    for (float theta : thetas) {
+        params.theta = theta;
+        double ms = bestMilliseconds(1, [&] { computeGravityBarnesHut(sys, params, octree, &pool); });
+        tree.push_back(Setting{theta, ms, sampledError(cluster, exact)});
+        if (tree.back().error <= targets[3]) break;
+    }
+    params.theta = kFmmTheta;
+    for (int order : orders) {
+        FmmSolver solver(order);
+        double ms = bestMilliseconds(1, [&] { solver.compute(sys, params, &pool); });
+        fmm.push_back(Setting{(double)order, ms, sampledError(cluster, exact)});
+        if (fmm.back().error <= targets[3]) break;
+    }
+
+    std::printf("%8s | %10s %10s | %7s %10s | %6s %10s\n", "error", "direct ms", "error", "theta", "tree ms",
+                "order", "fmm ms");
+    for (double target : targets) {
+        const Setting* t = fastestWithin(tree, target);
+        const Setting* f = fastestWithin(fmm, target);
+        std::printf("%8.0e | %10.2f %10.1e |", target, directMs, directError);
+        if (t) std::printf(" %7.2f %10.2f |", t->knob, t->ms);
+        else std::printf(" %7s %10s |", "-", "-");
+        if (f) std::printf(" %6.0f %10.2f\n", f->knob, f->ms);
+        else std::printf(" %6s %10s\n", "-", "-");
+    }
+    return 0;
+}
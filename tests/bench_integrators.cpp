@@ -0,0 +1,155 @@
+// Energy drift of every Integrator on a sun with eight planets, the shape
+// of the simulator's mutual-gravity scene, over a range of step sizes.
+// Prints force passes, per-body force evaluations, time and the worst and
+// final relative energy error, so schemes can be compared at equal error:
+// the higher orders should reach a given error with several times longer
+// steps. BLOCK_LEAPFROG runs through BlockTimesteps with its steps chosen
+// per body, advanced by the listed step the way the physics thread does.
+//
+// A second table counts force evaluations for global and block leapfrog on
+// the render3d layout at 1x time speed, one advance per physics tick.
+#include "bench.h"
+#include "../integrator.h"
+#include "../blocksteps.h"
+#include "../kepler.h"
+
+// nearly circular, slightly tilted orbits from 35 to 280 units out. The
+// planets are light enough that these packed orbits stay regular over the
+// run, so the energy error measured is the integrator's, not chaos.
+static Planets solarSystem() {
+    Planets p;
+    const float sunMass = 1000.0f;
+    p.add(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, sunMass);
+    const float radii[] = {35.0f, 55.0f, 75.0f, 100.0f, 140.0f, 180.0f, 230.0f, 280.0f};
+    for (int k = 0; k < 8; ++k) {
+        float angle = 0.7f * k;
+        float speed = std::sqrt(kGravity * sunMass / radii[k]) * (k % 2 ? 1.02f : 0.98f);
+        float c = std::cos(angle), s = std::sin(angle), tilt = 0.03f * (k - 4);
+        p.add(radii[k] * c, radii[k] * s, 0.0f, -speed * s, speed * c, speed * tilt, 0.1f);
+    }
+    return p;
+}
+
+struct Drift {
+    long passes = 0;
+    uint64_t evaluations = 0;       // accelerations computed, one per target body
+    double worst = 0.0, final = 0.0, ms = 0.0;
+};
+
+// The render3d scene as it enters mutual gravity: the sun, the 14 scripted
+// planets and the 2 perpendicular orbiters at their scripted positions at
+// time 0, with the circular speeds seedOrbitalVelocities gives them.
+static Planets render3dLayout() {
+    struct Orbit { float a, e, period, angle, tiltDegrees; };
+    const Orbit orbits[] = {
+        {35, 0.25f, 3.5f, 0.0f, 0}, {55, 0.15f, 5.8f, 1.2f, 0}, {75, 0.12f, 7.2f, 2.1f, 0},
+        {100, 0.18f, 10.5f, 3.8f, 0}, {140, 0.35f, 15.2f, 0.5f, 0}, {180, 0.08f, 22.0f, 0.9f, 0},
+        {250, 0.10f, 35.0f, 4.5f, 0}, {320, 0.06f, 48.0f, 1.7f, 0}, {400, 0.04f, 65.0f, 5.2f, 0},
+        {480, 0.25f, 85.0f, 2.8f, 0}, {550, 0.15f, 105.f, 1.1f, 0}, {620, 0.30f, 125.f, 4.7f, 0},
+        {720, 0.20f, 150.f, 0.3f, 0}, {800, 0.12f, 180.f, 3.9f, 0},
+        {150, 0.0f, 18.0f, 0.0f, 85.0f}, {220, 0.0f, 28.0f, 0.0f, 70.0f},
+    };
+    const float sunMass = 1000.0f;
+
+    KeplerOrbits kepler;
+    for (const Orbit& o : orbits) {
+        float tilt = o.tiltDegrees * 3.14159265f / 180.0f;
+        kepler.add(o.a, o.e, o.period, o.angle, 1.0f, 0.0f, 0.0f, 0.0f, std::cos(tilt), std::sin(tilt));
+    }
+    std::vector<float> x(kepler.size()), y(kepler.size()), z(kepler.size());
+    kepler.propagate(0.0, x.data(), y.data(), z.data());
+
+    Planets p;
+    p.add(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, sunMass);
+    for (size_t k = 0; k < kepler.size(); ++k) {
+        float tilt = orbits[k].tiltDegrees * 3.14159265f / 180.0f;
+        float nx = 0.0f, ny = -std::sin(tilt), nz = std::cos(tilt);
+        float r = std::sqrt(x[k]*x[k] + y[k]*y[k] + z[k]*z[k]);
+        float speed = std::sqrt(kGravity * sunMass / r);
+        float tx = ny * z[k] - nz * y[k], ty = nz * x[k] - nx * z[k], tz = nx * y[k] - ny * x[k];
+        float len = std::sqrt(tx*tx + ty*ty + tz*tz);
+        p.add(x[k], y[k], z[k], tx / len * speed, ty / len * speed, tz / len * speed, 1.0f);
+    }
+    return p;
+}
+
+static Drift run(const Planets& initial, Integrator integrator, float dt, double duration) {
+    Planets bodies = initial;
+    GravitySystem sys = bodies.system();
+    const GravityParams params = {kGravity, kSoftening, 0.0f};
+    const double e0 = bodies.energy();
+    const long steps = (long)std::ceil(duration / dt);
+    const long sample = std::max(1L, steps / 2000);
+    Drift drift;
+
+    auto start = std::chrono::steady_clock::now();
+    if (integrator == BLOCK_LEAPFROG) {
+        BlockTimesteps blocks(kBlockMaxStep, kBlockEta);
+        auto forcesFor = [&](const uint32_t* targets, size_t count) {
+            GravitySystem active = sys;
+            active.targets = targets;
+            active.targetCount = count;
+            computeGravityDirect(active, params);
+            ++drift.passes;
+        };
+        for (long n = 0; n < steps; ++n) {
+            blocks.advance(bodies, dt, kMaxPhysicsSubsteps, forcesFor);
+            if (n % sample == 0 || n == steps - 1) {
+                Planets synced = bodies;
+                BlockTimesteps copy = blocks;
+                copy.synchronize(synced);
+                drift.worst = std::max(drift.worst, std::fabs((synced.energy() - e0) / e0));
+                if (n == steps - 1) drift.final = (synced.energy() - e0) / e0;
+            }
+        }
+        drift.evaluations = blocks.forceEvaluations();
+    } else {
+        auto forces = [&] { computeGravityDirect(sys, params); ++drift.passes; };
+        forces();
+        for (long n = 0; n < steps; ++n) {
+            integrateStep(bodies, integrator, dt, forces);
+            if (n % sample == 0 || n == steps - 1) {
+                double error = (bodies.energy() - e0) / e0;
+                drift.worst = std::max(drift.worst, std::fabs(error));
+                drift.final = error;
+            }
+        }
+        drift.evaluations = (uint64_t)drift.passes * bodies.size();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    drift.ms = elapsed.count();
+    return drift;
+}
+
+int main(int argc, char** argv) {
+    const double duration = argc > 1 ? std::atof(argv[1]) : 200.0;
+    const float steps[] = {1.0f / 120.0f, 1.0f / 30.0f, 1.0f / 8.0f, 1.0f / 4.0f};
+
+    const Planets planets = solarSystem();
+    std::printf("9 bodies over %.0f time units (inner period %.1f)\n", duration,
+                2.0 * M_PI * std::sqrt(35.0 * 35.0 * 35.0 / (kGravity * 1000.0)));
+    std::printf("%-28s %9s %10s %10s %10s %12s %12s\n", "integrator", "step", "passes", "evals", "ms",
+                "worst dE/E", "final dE/E");
+    for (int i = 0; i < INTEGRATOR_COUNT; ++i) {
+        Integrator integrator = (Integrator)i;
+        for (float dt : steps) {
+            Drift d = run(planets, integrator, dt, duration);
+            std::printf("%-28s %9.4f %10ld %10llu %10.1f %12.3e %12.3e\n", integratorScheme(integrator).name, dt,
+                        d.passes, (unsigned long long)d.evaluations, d.ms, d.worst, d.final);
+        }
+    }
+
+    // the physics thread at 1x: one advance of kDt per tick
+    const double layoutDuration = 300.0;
+    const Planets layout = render3dLayout();
+    Drift global = run(layout, LEAPFROG, kDt, layoutDuration);
+    Drift block = run(layout, BLOCK_LEAPFROG, kDt, layoutDuration);
+    std::printf("\nrender3d layout, %zu bodies over %.0f time units at 1x\n", layout.size(), layoutDuration);
+    std::printf("%-28s %10s %10s %12s\n", "integrator", "evals", "ms", "worst dE/E");
+    std::printf("%-28s %10llu %10.1f %12.3e\n", integratorScheme(LEAPFROG).name,
+                (unsigned long long)global.evaluations, global.ms, global.worst);
+    std::printf("%-28s %10llu %10.1f %12.3e\n", integratorScheme(BLOCK_LEAPFROG).name,
+                (unsigned long long)block.evaluations, block.ms, block.worst);
+    std::printf("block steps evaluate %.1fx fewer accelerations\n", (double)global.evaluations / block.evaluations);
+    return 0;
+}
@@ -0,0 +1,79 @@
+// Frame time of the 2D simulator's physics against body count, 3 to 10,000
+// bodies: the force and collision stages of stepObjects, next to the
+// original per-body loop (every ordered pair, collisions inside the body
+// loop, so O(n^3)) where that still finishes.
+#include "bench.h"
+#include "../physics2d.h"
+
+static const int kWidth = 1600, kHeight = 1200;
+
+static std::vector<Object> scene(size_t count) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> px(0.0f, (float)kWidth), py(0.0f, (float)kHeight), v(-3.0f, 3.0f);
+    std::vector<Object> objects;
+    for (size_t i = 0; i < count; ++i) {
+        objects.push_back(Object({px(rng), py(rng)}, {v(rng), v(rng)}, 7.35e17f, 4.0f));
+    }
+    return objects;
+}
+
+// render2d's frame before the force stage, minus drawing and printing
+static void originalFrame(std::vector<Object> &objects) {
+    for (auto &obj : objects) {
+        for (auto &obj2 : objects) {
+            if (&obj2 == &obj) continue;
+
+            float dx = obj2.position[0] - obj.position[0];
+            float dy = obj2.position[1] - obj.position[1];
+            float dist = sqrt(dx*dx + dy*dy);
+            dist *= 75;
+
+            std::vector<float> dir = {dx / dist, dy/ dist};
+
+            float Gforce = (G * obj.mass * obj2.mass) / (dist * dist);
+
+            float acc1 = Gforce / obj.mass;
+            float acc2 = Gforce / obj2.mass;
+
+            obj.accelerate(acc1 * dir[0], acc1 * dir[1]);
+            obj2.accelerate(-acc2 * dir[0], -acc2 * dir[1]);
+        }
+
+        obj.updatePos();
+
+        for (size_t i = 0; i < objects.size(); ++i) {
+            for (size_t j = i + 1; j < objects.size(); ++j) {
+                handleCollision(objects[i], objects[j]);
+            }
+        }
+
+        handleBorders(obj, kWidth, kHeight);
+        obj.velocity[0] *= 0.99999f;
+        obj.velocity[1] *= 0.99999f;
+    }
+}
+
+int main() {
+    ThreadPool pool;
+    std::printf("%u threads, %s kernels\n", pool.size(), simdLevelName(simdLevel()));
+    std::printf("%8s %14s %14s %9s\n", "bodies", "frame ms", "original ms", "speedup");
+
+    const size_t counts[] = {3, 10, 30, 100, 300, 1000, 3000, 10000};
+    for (size_t count : counts) {
+        const int frames = count <= 1000 ? 20 : 3;
+
+        std::vector<Object> objects = scene(count);
+        ForceBuffers forces;
+        accumulateForces(objects, forces, pool);
+        double frame = bestMilliseconds(frames, [&] { stepObjects(objects, forces, pool, kWidth, kHeight); });
+
+        if (count <= 300) {
+            std::vector<Object> original = scene(count);
+            double before = bestMilliseconds(frames, [&] { originalFrame(original); });
+            std::printf("%8zu %14.4f %14.4f %8.1fx\n", count, frame, before, before / frame);
+        } else {
+            std::printf("%8zu %14.4f %14s %9s\n", count, frame, "-", "-");
+        }
+    }
+    return 0;
+}
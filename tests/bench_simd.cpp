@@ -0,0 +1,34 @@
+// Direct-sum kernels on one thread: scalar, AVX2 and AVX-512 over the same
+// bodies, as interactions per second and speedup over scalar.
+#include "bench.h"
+
+typedef void (*Kernel)(const GravitySystem&, const GravityParams&, size_t, size_t);
+
+int main() {
+    const size_t counts[] = {1000, 4000, 16000};
+    struct Named { const char* name; Kernel kernel; SimdLevel level; };
+    std::vector<Named> kernels = {{"scalar", directSumScalar, SIMD_SCALAR}};
+#if GRAVITY_SIMD_X86
+    kernels.push_back(Named{"AVX2", directSumAvx2, SIMD_AVX2});
+    kernels.push_back(Named{"AVX-512", directSumAvx512, SIMD_AVX512});
+#endif
+
+    std::printf("this CPU: %s\n", simdLevelName(simdLevel()));
+    std::printf("%8s %9s %12s %14s %9s\n", "bodies", "kernel", "ms", "Gpairs/s", "speedup");
+    for (size_t count : counts) {
+        Cluster cluster(count);
+        GravitySystem sys = cluster.system();
+        const GravityParams params = {1.0f, 0.5f, 0.0f};
+        const int repeats = count <= 4000 ? 10 : 3;
+
+        double scalarMs = 0.0;
+        for (const Named& k : kernels) {
+            if (simdLevel() < k.level) continue;
+            double ms = bestMilliseconds(repeats, [&] { k.kernel(sys, params, 0, count); });
+            if (k.level == SIMD_SCALAR) scalarMs = ms;
+            double pairs = (double)count * (double)count / (ms * 1e6);
+            std::printf("%8zu %9s %12.3f %14.2f %8.1fx\n", count, k.name, ms, pairs, scalarMs / ms);
+        }
+    }
+    return 0;
+}
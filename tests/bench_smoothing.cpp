@@ -0,0 +1,128 @@
+// Grid curvature smoothing: CurvatureSmoother (mask rasterized body by
+// body, then the branch-free 1D passes) against the loop it replaced,
+// which scanned every body at every point and branched per kernel, on one
+// thread over the whole grid. Checks the two agree.
+#include "bench.h"
+#include "../smoothing.h"
+
+// planets in a disc around the grid plane, as the simulator's Store
+struct PlanetDisc {
+    std::vector<float> x, y, z, mass;
+    size_t size() const { return x.size(); }
+
+    PlanetDisc(size_t count, float radius, float planeZ, uint32_t seed = 1) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> weight(0.5f, 50.0f);
+        x.push_back(0.0f); y.push_back(0.0f); z.push_back(0.0f);
+        mass.push_back(2.0f * CurvatureField::kStarMass);      // a star, which the mask skips
+        for (size_t i = 1; i < count; ++i) {
+            x.push_back(unit(rng) * radius); y.push_back(unit(rng) * radius);
+            z.push_back(planeZ + unit(rng) * 40.0f);
+            mass.push_back(weight(rng));
+        }
+    }
+};
+
+// the smoothing loop before CurvatureSmoother (render3d.cpp)
+static void originalSmooth(const FieldGrid& grid, const PlanetDisc& bodies, float nearPlanetRadius,
+                           const std::vector<float>& curvatures, std::vector<float>& smoothed) {
+    const int n = grid.ny;
+    const int gridSize = grid.nx - 1;
+    auto at = [&](int i, int j) { return curvatures[(size_t)i * n + j]; };
+    for (int i = 0; i <= gridSize; ++i) {
+        for (int j = 0; j <= gridSize; ++j) {
+            float currentCurvature = at(i, j);
+            if (i == 0 || j == 0 || i == gridSize || j == gridSize) {
+                smoothed[(size_t)i * n + j] = currentCurvature;
+                continue;
+            }
+
+            bool nearPlanet = false;
+            float x = grid.originX + i * grid.spacing;
+            float y = grid.originY + j * grid.spacing;
+            for (size_t b = 0; b < bodies.size(); ++b) {
+                if (bodies.mass[b] <= CurvatureField::kStarMass) {
+                    float dx = x - bodies.x[b], dy = y - bodies.y[b], dz = grid.z - bodies.z[b];
+                    if (std::sqrt(dx*dx + dy*dy + dz*dz) < nearPlanetRadius) {
+                        nearPlanet = true;
+                        break;
+                    }
+                }
+            }
+
+            if (nearPlanet) {
+                float sum = currentCurvature * 6.0f;
+                sum += at(i-1, j) * 0.5f;
+                sum += at(i+1, j) * 0.5f;
+                sum += at(i, j-1) * 0.5f;
+                sum += at(i, j+1) * 0.5f;
+                smoothed[(size_t)i * n + j] = sum / 8.0f;
+            } else {
+                float sum = 0.0f;
+                int count = 0;
+                for (int di = -1; di <= 1; ++di) {
+                    for (int dj = -1; dj <= 1; ++dj) {
+                        int ni = i + di;
+                        int nj = j + dj;
+                        if (ni >= 0 && ni <= gridSize && nj >= 0 && nj <= gridSize) {
+                            float weight = (di == 0 && dj == 0) ? 4.0f : 1.0f;
+                            sum += at(ni, nj) * weight;
+                            count += (int)weight;
+                        }
+                    }
+                }
+                smoothed[(size_t)i * n + j] = sum / (float)count;
+            }
+        }
+    }
+}
+
+int main() {
+    // spacing, plane height and near-planet radius of the simulator's grid (assets.h)
+    const float spacing = 15.0f, baseZ = 15.0f, nearPlanetRadius = 60.0f;
+    struct Case { int gridSize; size_t bodies; };
+    const Case cases[] = {{120, 17}, {120, 300}, {1000, 300}, {1000, 5000}};
+
+    std::printf("this CPU: %s\n", simdLevelName(simdLevel()));
+    std::printf("%7s %7s %12s %12s %9s %12s\n", "grid", "bodies", "original ms", "smoother ms", "speedup",
+                "worst diff");
+    double worst = 0.0;
+    for (const Case& c : cases) {
+        const int n = c.gridSize + 1;
+        const float origin = -(c.gridSize / 2) * spacing;
+        const FieldGrid grid = {origin, origin, spacing, baseZ, n, n};
+        PlanetDisc bodies(c.bodies, -origin, baseZ);
+
+        std::mt19937 rng(2);
+        std::uniform_real_distribution<float> curvature(0.0f, 60.0f);
+        std::vector<float> raw((size_t)n * n);
+        for (float& v : raw) v = curvature(rng);
+
+        std::vector<float> reference(raw.size()), smoothed(raw.size());
+        CurvatureSmoother smoother;
+        FrameArena scratch;
+        const int repeats = c.gridSize <= 120 ? 20 : 3;
+        double originalMs = bestMilliseconds(repeats, [&] {
+            originalSmooth(grid, bodies, nearPlanetRadius, raw, reference);
+        });
+        double smootherMs = bestMilliseconds(repeats, [&] {
+            scratch.reset();
+            smoother.rasterizeMask(grid, bodies, nearPlanetRadius, CurvatureField::kStarMass, scratch);
+            smoother.smooth(grid, raw.data(), smoothed.data(), 0, n, 0, n);
+        });
+
+        // only the summation order differs
+        double diff = 0.0;
+        for (size_t k = 0; k < raw.size(); ++k)
+            diff = std::max(diff, std::fabs((double)smoothed[k] - reference[k]) / std::max(1.0f, std::fabs(reference[k])));
+        worst = std::max(worst, diff);
+        std::printf("%5d^2 %7zu %12.3f %12.3f %8.1fx %12.2e\n", n, c.bodies, originalMs, smootherMs,
+                    originalMs / smootherMs, diff);
+    }
+    if (worst > 1e-5) {
+        std::cerr << "smoother differs from the original loop by " << worst << "\n";
+        return 1;
+    }
+    return 0;
+}
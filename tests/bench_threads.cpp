@@ -0,0 +1,34 @@
+// Force pass time against thread count, 1 to 64 threads, for direct sum and
+// Barnes-Hut on the same cluster. Past the core count the curve should stay
+// flat rather than fall off; results are identical for every count.
+#include "bench.h"
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 20000;
+    Cluster cluster(count);
+    GravitySystem sys = cluster.system();
+    const GravityParams params = {1.0f, 0.5f, 0.5f};
+    Octree tree;
+
+    std::printf("%zu bodies, %u cores, %s kernels\n", count, std::thread::hardware_concurrency(),
+                simdLevelName(simdLevel()));
+    std::printf("%8s %12s %9s %12s %9s\n", "threads", "direct ms", "speedup", "tree ms", "speedup");
+
+    double directBase = 0.0, treeBase = 0.0;
+    Accelerations reference;
+    bool deterministic = true;
+    for (unsigned threads = 1; threads <= 64; threads *= 2) {
+        ThreadPool pool(threads);
+        double direct = bestMilliseconds(3, [&] { computeGravityDirect(sys, params, &pool); });
+        if (threads == 1) reference = accelerationsOf(cluster);
+        else deterministic = deterministic && relativeError(cluster, reference) == 0.0;
+
+        double treeTime = bestMilliseconds(3, [&] { computeGravityBarnesHut(sys, params, tree, &pool); });
+        if (threads == 1) { directBase = direct; treeBase = treeTime; }
+        std::printf("%8u %12.2f %8.2fx %12.2f %8.2fx\n", threads, direct, directBase / direct,
+                    treeTime, treeBase / treeTime);
+    }
+
+    std::printf("direct sum results %s across thread counts\n", deterministic ? "identical" : "DIFFER");
+    return deterministic ? 0 : 1;
+}
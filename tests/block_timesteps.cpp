@@ -0,0 +1,79 @@
+// Block timestep regressions on a sun with two planets, the inner one on
+// level 7, advanced by kDt * speed per tick as the physics thread does.
+//   backend switch   forces alternate between direct sum and Barnes-Hut
+//                    every 7 ticks with the scheduler left running, as
+//                    GravitySolvers::switchForces does; the drift must stay
+//                    within a few times the run on one backend
+//   time speed       from 1x to 3000x every tick's time must be simulated,
+//                    none dropped at the sync point cap
+#include "bench.h"
+#include "../blocksteps.h"
+
+static Planets threeBodies() {
+    Planets p;
+    const float sunMass = 1000.0f;
+    p.add(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, sunMass);
+    const float radii[] = {35.0f, 150.0f};
+    for (float r : radii) p.add(r, 0.0f, 0.0f, 0.0f, std::sqrt(kGravity * sunMass / r), 0.0f, 1.0f);
+    return p;
+}
+
+struct Run {
+    double drift = 0.0;     // final |dE/E|
+    double simulated = 0.0;
+};
+
+static Run advance(float speed, int ticks, int switchEvery) {
+    Planets bodies = threeBodies();
+    GravitySystem sys = bodies.system();
+    const GravityParams params = {kGravity, kSoftening, 0.5f};
+    const double e0 = bodies.energy();
+    BlockTimesteps blocks(kBlockMaxStep, kBlockEta);
+    Octree tree;
+    bool barnesHut = false;
+    auto forcesFor = [&](const uint32_t* targets, size_t count) {
+        GravitySystem active = sys;
+        active.targets = targets;
+        active.targetCount = count;
+        if (barnesHut) computeGravityBarnesHut(active, params, tree);
+        else computeGravityDirect(active, params);
+    };
+
+    for (int t = 0; t < ticks; ++t) {
+        if (switchEvery > 0 && t % switchEvery == 0) barnesHut = !barnesHut;
+        blocks.advance(bodies, kDt * speed, kMaxPhysicsSubsteps, forcesFor);
+    }
+    Run run;
+    run.simulated = blocks.time();
+    blocks.synchronize(bodies);
+    run.drift = std::fabs((bodies.energy() - e0) / e0);
+    return run;
+}
+
+int main() {
+    bool passed = true;
+
+    // 10 time units, a few inner orbits
+    const int ticks = 1200;
+    Run plain = advance(1.0f, ticks, 0);
+    Run switched = advance(1.0f, ticks, 7);
+    bool ok = switched.drift <= 4.0 * plain.drift + 1e-6;
+    std::printf("backend switch every 7 ticks: |dE/E| %.3e, without switches %.3e %s\n", switched.drift,
+                plain.drift, ok ? "" : "FAIL");
+    passed = passed && ok;
+
+    std::printf("%8s %12s %12s %12s\n", "speed", "requested", "simulated", "|dE/E|");
+    const float speeds[] = {1.0f, 10.0f, 100.0f, 300.0f, 1000.0f, 3000.0f};
+    for (float speed : speeds) {
+        const int speedTicks = 120;
+        Run r = advance(speed, speedTicks, 0);
+        double requested = (double)speedTicks * kDt * speed;
+        // what is still pending is less than one step at level 0
+        ok = r.simulated <= requested + 1e-6 && r.simulated > requested - kBlockMaxStep;
+        std::printf("%7.0fx %12.2f %12.2f %12.3e %s\n", speed, requested, r.simulated, r.drift, ok ? "" : "FAIL");
+        passed = passed && ok;
+    }
+
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
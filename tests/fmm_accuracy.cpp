@@ -0,0 +1,35 @@
+// FMM against a double-precision direct sum at the simulator's expansion
+// order and separation (kFmmOrder, kFmmTheta). Fails above 1e-6 RMS relative
+// force error, or when raising the order does not lower the error.
+#include "bench.h"
+#include "../fmm.h"
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 10000;
+    const double maxError = 1e-6;
+    const int orders[] = {4, 6, 8, kFmmOrder};
+
+    Cluster cluster(count);
+    GravitySystem sys = cluster.system();
+    ThreadPool pool;
+    const GravityParams params = {1.0f, 0.5f, kFmmTheta};
+    ExactSample exact = exactSample(cluster, params, 1000);
+
+    std::printf("%zu bodies, theta %.2f\n", count, kFmmTheta);
+    std::printf("%6s %10s %12s\n", "order", "ms", "rms error");
+
+    bool passed = true;
+    double previous = 1.0;
+    for (int order : orders) {
+        FmmSolver fmm(order);
+        double ms = bestMilliseconds(1, [&] { fmm.compute(sys, params, &pool); });
+        double error = sampledError(cluster, exact);
+        bool ok = error < previous && (order != kFmmOrder || error <= maxError);
+        std::printf("%6d %10.1f %12.3e %s\n", order, ms, error, ok ? "" : "FAIL");
+        passed = passed && ok;
+        previous = error;
+    }
+
+    std::printf("%s (order %d must reach %.0e)\n", passed ? "PASS" : "FAIL", kFmmOrder, maxError);
+    return passed ? 0 : 1;
+}
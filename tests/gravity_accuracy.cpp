@@ -0,0 +1,42 @@
+// Barnes-Hut against direct summation: force error and time for a range of
+// opening angles. Fails when the RMS relative error of any theta passes its
+// threshold, or when a smaller theta is not more accurate than a larger one.
+#include "bench.h"
+
+struct ThetaCase {
+    float theta;
+    double maxRmsError;     // RMS of |a - a_direct| over RMS |a_direct|
+};
+
+int main(int argc, char** argv) {
+    const size_t count = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : 20000;
+    const ThetaCase cases[] = {{0.2f, 1e-3}, {0.35f, 3e-3}, {0.5f, 1e-2}, {0.7f, 2e-2}, {1.0f, 5e-2}};
+
+    Cluster cluster(count);
+    GravitySystem sys = cluster.system();
+    ThreadPool pool;
+    GravityParams params = {1.0f, 0.5f, 0.0f};
+
+    double direct = bestMilliseconds(3, [&] { computeGravityDirect(sys, params, &pool); });
+    Accelerations reference = accelerationsOf(cluster);
+    std::printf("%zu bodies, direct sum %.2f ms\n", count, direct);
+    std::printf("%7s %10s %10s %12s %12s %10s\n", "theta", "ms", "speedup", "rms error", "worst error", "limit");
+
+    bool passed = true;
+    double previous = 0.0;
+    Octree tree;
+    for (const ThetaCase& c : cases) {
+        params.theta = c.theta;
+        double ms = bestMilliseconds(3, [&] { computeGravityBarnesHut(sys, params, tree, &pool); });
+        double rms = relativeError(cluster, reference);
+        double worst = worstError(cluster, reference);
+        bool ok = rms <= c.maxRmsError && rms >= previous;
+        std::printf("%7.2f %10.2f %9.1fx %12.3e %12.3e %10.0e %s\n", c.theta, ms, direct / ms, rms, worst,
+                    c.maxRmsError, ok ? "" : "FAIL");
+        passed = passed && ok;
+        previous = rms;
+    }
+
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+// The AVX2 and AVX-512 direct-sum kernels against directSumScalar, on every
+// body count from 1 to 48 (every tail length of both vector widths) and a
+// few larger ones, with full and subset targets. Zero softening puts each
+// target on top of itself, so the lanes that must be masked out are there
+// too. Kernels this CPU cannot run are skipped.
+#include "bench.h"
+
+typedef void (*Kernel)(const GravitySystem&, const GravityParams&, size_t, size_t);
+
+// largest component error over the body's acceleration magnitude
+static double compare(Kernel kernel, Cluster& cluster, const std::vector<uint32_t>* targets, float softening) {
+    GravitySystem sys = cluster.system();
+    if (targets) {
+        sys.targets = targets->data();
+        sys.targetCount = targets->size();
+    }
+    const GravityParams params = {1.0f, softening, 0.0f};
+    const size_t n = sys.targetTotal();
+
+    directSumScalar(sys, params, 0, n);
+    Accelerations reference = accelerationsOf(cluster);
+    std::fill(cluster.ax.begin(), cluster.ax.end(), -1.0f);
+    std::fill(cluster.ay.begin(), cluster.ay.end(), -1.0f);
+    std::fill(cluster.az.begin(), cluster.az.end(), -1.0f);
+    kernel(sys, params, 0, n);
+
+    double worst = 0.0;
+    for (size_t k = 0; k < n; ++k) {
+        size_t i = sys.target(k);
+        double scale = std::sqrt((double)reference.x[i] * reference.x[i] + (double)reference.y[i] * reference.y[i] +
+                                 (double)reference.z[i] * reference.z[i]);
+        double error = std::max(std::fabs(cluster.ax[i] - reference.x[i]),
+                                std::max(std::fabs(cluster.ay[i] - reference.y[i]),
+                                         std::fabs(cluster.az[i] - reference.z[i])));
+        if (!std::isfinite(cluster.ax[i]) || !std::isfinite(cluster.ay[i]) || !std::isfinite(cluster.az[i])) return 1e30;
+        worst = std::max(worst, scale > 0.0 ? error / scale : error);
+    }
+    return worst;
+}
+
+int main() {
+    const double tolerance = 1e-5;
+    std::vector<size_t> counts;
+    for (size_t n = 1; n <= 48; ++n) counts.push_back(n);
+    for (size_t n : {127, 128, 129, 1000, 4097}) counts.push_back(n);
+
+    struct Named { const char* name; Kernel kernel; SimdLevel level; };
+    std::vector<Named> kernels;
+#if GRAVITY_SIMD_X86
+    kernels.push_back(Named{"AVX2", directSumAvx2, SIMD_AVX2});
+    kernels.push_back(Named{"AVX-512", directSumAvx512, SIMD_AVX512});
+#endif
+
+    bool passed = true;
+    int checked = 0;
+    for (const Named& k : kernels) {
+        if (simdLevel() < k.level) {
+            std::printf("%-8s skipped, not supported here\n", k.name);
+            continue;
+        }
+        double worst = 0.0;
+        for (size_t n : counts) {
+            Cluster cluster(n, 100.0f, (uint32_t)n);
+            std::vector<uint32_t> odd;
+            for (size_t i = 1; i < n; i += 2) odd.push_back((uint32_t)i);
+
+            for (float softening : {0.5f, 0.0f}) {
+                worst = std::max(worst, compare(k.kernel, cluster, nullptr, softening));
+                worst = std::max(worst, compare(k.kernel, cluster, &odd, softening));
+            }
+        }
+        bool ok = worst <= tolerance;
+        std::printf("%-8s worst relative error %.3e over %zu body counts %s\n", k.name, worst, counts.size(),
+                    ok ? "" : "FAIL");
+        passed = passed && ok;
+        ++checked;
+    }
+
+    if (checked == 0) std::printf("no vector kernels to check on this CPU\n");
+    std::printf("%s\n", passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
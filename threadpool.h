@@ -0,0 +1,206 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+// Work-stealing thread pool. Every worker owns a deque: it pops its newest
+// task and, when empty, steals the oldest task from another worker. A thread
+// that calls parallelFor runs tasks too until its own batch is finished, so
+// nested calls and calls from several threads at once are fine.
+//
+// Tasks only carry a function pointer, a context and an index range, so
+// scheduling never allocates. Results are deterministic as long as every
+// index is written by exactly one tile, which is how all callers use it.
+
+class ThreadPool {
+public:
+    // threadCount counts the calling thread; 0 means GRAVITY_THREADS or all cores
+    explicit ThreadPool(unsigned threadCount = 0) {
+        if (threadCount == 0) threadCount = defaultThreadCount();
+        threadCount = std::max(1u, threadCount);
+
+        queues.reserve(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) queues.emplace_back(new WorkQueue());
+        for (unsigned i = 1; i < threadCount; ++i) workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    // GRAVITY_THREADS when it is a positive number, capped at four threads
+    // per core; otherwise one thread per core
+    static unsigned defaultThreadCount() {
+        const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        const long cap = 4l * cores;
+        const char* env = std::getenv("GRAVITY_THREADS");
+        if (!env) return cores;
+
+        char* end = nullptr;
+        long requested = std::strtol(env, &end, 10);
+        if (end == env || *end != '\0' || requested <= 0) {
+            std::cerr << "GRAVITY_THREADS=" << env << " is not a positive thread count, using "
+                      << cores << "\n";
+            return cores;
+        }
+        if (requested > cap) {
+            std::cerr << "GRAVITY_THREADS=" << env << " capped at " << cap
+                      << " (4 per core)\n";
+            return (unsigned)cap;
+        }
+        return (unsigned)requested;
+    }
+
+    // body(tileBegin, tileEnd) over [begin, end) cut into tiles of `grain`
+    template <typename Body>
+    void parallelFor(size_t begin, size_t end, size_t grain, const Body& body) {
+        if (end <= begin) return;
+        grain = std::max<size_t>(grain, 1);
+        if (queues.size() == 1 || end - begin <= grain) {
+            body(begin, end);
+            return;
+        }
+
+        std::atomic<size_t> pending((end - begin + grain - 1) / grain);
+        int home = currentQueue();
+        size_t slot = (home >= 0) ? (size_t)home : nextQueue.fetch_add(1, std::memory_order_relaxed);
+
+        for (size_t b = begin; b < end; b += grain) {
+            Task task = {&invoke<Body>, &body, b, std::min(b + grain, end), &pending};
+            WorkQueue& queue = *queues[(home >= 0 ? slot : slot++) % queues.size()];
+            if (!queue.push(task)) run(task);
+        }
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            ++epoch;
+        }
+        wake.notify_all();
+
+        // help until every tile of this batch is done
+        while (pending.load(std::memory_order_acquire) > 0) {
+            Task task;
+            if (findTask(home >= 0 ? (size_t)home : slot, task)) run(task);
+            else std::this_thread::yield();
+        }
+    }
+
+private:
+    struct Task {
+        void (*fn)(const void* ctx, size_t begin, size_t end);
+        const void* ctx;
+        size_t begin, end;
+        std::atomic<size_t>* pending;
+    };
+
+    // fixed-capacity ring; the owner works at the back, thieves at the front
+    struct WorkQueue {
+        static const size_t kCapacity = 4096;
+        std::mutex lock;
+        Task tasks[kCapacity];
+        size_t head = 0, tail = 0;
+
+        bool push(const Task& task) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail - head == kCapacity) return false;
+            tasks[tail++ % kCapacity] = task;
+            return true;
+        }
+        bool popBack(Task& task) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail == head) return false;
+            task = tasks[--tail % kCapacity];
+            return true;
+        }
+        bool stealFront(Task& task) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tail == head) return false;
+            task = tasks[head++ % kCapacity];
+            return true;
+        }
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> nextQueue{0};
+
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    size_t epoch = 0;
+    bool stopping = false;
+
+    template <typename Body>
+    static void invoke(const void* ctx, size_t begin, size_t end) {
+        (*static_cast<const Body*>(ctx))(begin, end);
+    }
+
+    struct WorkerIdentity {
+        const ThreadPool* pool;
+        int index;
+    };
+
+    static WorkerIdentity& currentWorker() {
+        static thread_local WorkerIdentity identity = {nullptr, -1};
+        return identity;
+    }
+
+    // the calling thread's own queue, or -1 for threads outside this pool
+    int currentQueue() const {
+        const WorkerIdentity& identity = currentWorker();
+        return (identity.pool == this) ? identity.index : -1;
+    }
+
+    static void run(const Task& task) {
+        task.fn(task.ctx, task.begin, task.end);
+        task.pending->fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    bool findTask(size_t home, Task& task) {
+        const size_t count = queues.size();
+        if (queues[home % count]->popBack(task)) return true;
+        for (size_t k = 1; k < count; ++k) {
+            if (queues[(home + k) % count]->stealFront(task)) return true;
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned index) {
+        currentWorker() = WorkerIdentity{this, (int)index};
+        size_t seen = 0;
+        for (;;) {
+            Task task;
+            if (findTask(index, task)) {
+                run(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [&] { return stopping || epoch != seen; });
+            if (stopping) return;
+            seen = epoch;
+        }
+    }
+};
+
+// parallelFor on the pool when there is one, a single inline call otherwise
+template <typename Body>
+static inline void forEachTile(ThreadPool* pool, size_t count, size_t grain, const Body& body) {
+    if (pool) pool->parallelFor(0, count, grain, body);
+    else body(0, count);
+}
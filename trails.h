@@ -0,0 +1,199 @@
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include "shader.h"
+
+// Orbit trails as fixed-capacity rings, one per body, all appended on the
+// same tick. Point (trail t, slot s) lives at row s, column t, so the
+// points of one tick are a single contiguous row: appending costs one
+// glBufferSubData of a row however many trails there are, and a trail is
+// read back with a stride of one row. The last row mirrors slot 0, so a
+// trail that wraps around is drawn as two strips that meet without a gap.
+//
+// Each point carries its slot, and the vertex shader turns the distance
+// from the newest slot into the old per-vertex fade and shimmer; nothing
+// is re-sent per frame. Without shaders the CPU copy is drawn in
+// immediate mode as before.
+
+class TrailRings {
+public:
+    TrailRings() = default;
+    TrailRings(const TrailRings&) = delete;
+    TrailRings& operator=(const TrailRings&) = delete;
+
+    void init(size_t trailCount, int pointsPerTrail) {
+        trails = trailCount;
+        capacity = pointsPerTrail;
+        points.assign(trails * (capacity + 1) * 4, 0.0f);
+        head = count = pendingRows = 0;
+        uploadedAll = false;
+    }
+
+    int size() const { return count; }
+
+    // appends the current position of every body to its trail
+    template <typename Store>
+    void append(const Store& bodies) {
+        const size_t n = std::min(trails, bodies.size());
+        float* row = &points[(size_t)head * trails * 4];
+        for (size_t t = 0; t < n; ++t) {
+            row[t * 4 + 0] = bodies.x[t];
+            row[t * 4 + 1] = bodies.y[t];
+            row[t * 4 + 2] = bodies.z[t];
+            row[t * 4 + 3] = (float)head;
+        }
+        if (head == 0) std::copy(row, row + trails * 4, &points[(size_t)capacity * trails * 4]);
+        head = (head + 1) % capacity;
+        count = std::min(count + 1, capacity);
+        pendingRows = std::min(pendingRows + 1, capacity);
+    }
+
+    // Draws trails [first, trails) in their body's colour times colorScale,
+    // fading from the oldest point to the newest; returns the draw calls.
+    template <typename Store>
+    int draw(const Store& bodies, size_t first, float colorScale, float time) {
+        const size_t last = std::min(trails, bodies.size());
+        if (count < 2 || first >= last) return 0;
+        glLineWidth(3.0f);
+        if (!ensureProgram()) {
+            drawImmediate(bodies, first, colorScale, time);
+            return (int)(last - first);
+        }
+        upload();
+
+        const int oldest = (head - count + capacity) % capacity;
+        GLint starts[2] = {oldest, 0};
+        GLsizei lengths[2] = {count, 0};
+        if (oldest + count > capacity) {
+            lengths[0] = capacity - oldest + 1;    // through the mirror of slot 0
+            lengths[1] = head;
+        }
+        const GLsizei runs = lengths[1] > 1 ? 2 : 1;
+
+        glUseProgram(program);
+        glUniform1f(uNewest, (float)((head - 1 + capacity) % capacity));
+        glUniform1f(uCount, (float)count);
+        glUniform1f(uCapacity, (float)capacity);
+        glUniform1f(uTime, time);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(0);
+        const GLsizei stride = (GLsizei)(trails * 4 * sizeof(float));
+        for (size_t t = first; t < last; ++t) {
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(t * 4 * sizeof(float)));
+            glVertexAttrib3f(1, bodies.color[t].x * colorScale, bodies.color[t].y * colorScale,
+                             bodies.color[t].z * colorScale);
+            glMultiDrawArrays(GL_LINE_STRIP, starts, lengths, runs);
+        }
+        glDisableVertexAttribArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glUseProgram(0);
+        return (int)(last - first);
+    }
+
+    // must run while the context is still current
+    void destroy() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+        if (program) glDeleteProgram(program);
+        buffer = program = 0;
+        uploadedAll = false;
+    }
+
+private:
+    size_t trails = 0;
+    int capacity = 0;
+    int head = 0;            // slot the next point goes to
+    int count = 0;           // points per trail so far, up to capacity
+    int pendingRows = 0;     // rows appended since the last upload
+    bool uploadedAll = false;
+    std::vector<float> points;   // (capacity + 1) rows of trails x (x, y, z, slot)
+
+    GLuint program = 0, buffer = 0;
+    bool programFailed = false;
+    GLint uNewest = -1, uCount = -1, uCapacity = -1, uTime = -1;
+
+    bool ensureProgram() {
+        if (program) return true;
+        if (programFailed) return false;
+        program = buildProgram("orbit trail", kVertexShader, kFragmentShader, {"point", "trailColor"});
+        if (!program) {
+            programFailed = true;
+            return false;
+        }
+        uNewest = glGetUniformLocation(program, "newestSlot");
+        uCount = glGetUniformLocation(program, "count");
+        uCapacity = glGetUniformLocation(program, "capacity");
+        uTime = glGetUniformLocation(program, "time");
+        glGenBuffers(1, &buffer);
+        return true;
+    }
+
+    // sends the rows appended since the last upload, and the mirror row if slot 0 was among them
+    void upload() {
+        const size_t rowBytes = trails * 4 * sizeof(float);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (!uploadedAll) {
+            glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(float), points.data(), GL_DYNAMIC_DRAW);
+            uploadedAll = true;
+        } else if (pendingRows > 0) {
+            int start = (head - pendingRows + capacity) % capacity;
+            int firstRun = std::min(pendingRows, capacity - start);
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(start * rowBytes), (GLsizeiptr)(firstRun * rowBytes),
+                            &points[(size_t)start * trails * 4]);
+            if (firstRun < pendingRows) {
+                glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)((pendingRows - firstRun) * rowBytes), points.data());
+            }
+            if (start == 0 || firstRun < pendingRows) {
+                glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)(capacity * rowBytes), (GLsizeiptr)rowBytes,
+                                &points[(size_t)capacity * trails * 4]);
+            }
+        }
+        pendingRows = 0;
+    }
+
+    template <typename Store>
+    void drawImmediate(const Store& bodies, size_t first, float colorScale, float time) const {
+        const int oldest = (head - count + capacity) % capacity;
+        for (size_t t = first; t < std::min(trails, bodies.size()); ++t) {
+            glBegin(GL_LINE_STRIP);
+            for (int i = 0; i < count; ++i) {
+                float alpha = (float)i / (float)(count - 1);
+                alpha = alpha * alpha * alpha;
+                float shimmer = (0.8f + 0.2f * sinf((float)i * 0.1f + time * 3.0f)) * colorScale;
+                glColor4f(bodies.color[t].x * shimmer, bodies.color[t].y * shimmer, bodies.color[t].z * shimmer,
+                          alpha * 0.95f);
+                const float* p = &points[((size_t)((oldest + i) % capacity) * trails + t) * 4];
+                glVertex3f(p[0], p[1], p[2]);
+            }
+            glEnd();
+        }
+    }
+
+    // slot i steps back from the newest point, which is fully opaque
+    static constexpr const char* kVertexShader = R"(
+        #version 120
+        attribute vec4 point;
+        attribute vec3 trailColor;
+        uniform float newestSlot, count, capacity, time;
+        varying vec4 color;
+
+        void main() {
+            float age = newestSlot - point.w;
+            if (age < 0.0) age += capacity;
+            float i = count - 1.0 - age;
+            float alpha = i / (count - 1.0);
+            float shimmer = 0.8 + 0.2 * sin(i * 0.1 + time * 3.0);
+            color = vec4(trailColor * shimmer, alpha * alpha * alpha * 0.95);
+            gl_Position = gl_ModelViewProjectionMatrix * vec4(point.xyz, 1.0);
+        }
+    )";
+
+    static constexpr const char* kFragmentShader = R"(
+        #version 120
+        varying vec4 color;
+        void main() { gl_FragColor = color; }
+    )";
+};
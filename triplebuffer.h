@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer triple buffer. The writer fills its back
+// slot and swaps it with the shared middle slot; the reader swaps its front
+// slot with the middle one when a fresh value is waiting. Neither side ever
+// blocks or waits for the other, and the reader always sees a complete value.
+
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() = default;
+    explicit TripleBuffer(const T& initial) { slots[0] = slots[1] = slots[2] = initial; }
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // writer side
+    T& back() { return slots[backIndex]; }
+    void publish() {
+        backIndex = middle.exchange((uint8_t)(backIndex | kFresh), std::memory_order_acq_rel) & kIndexMask;
+    }
+
+    // reader side; returns true when a newer value became the front slot
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh)) return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & kIndexMask;
+        return true;
+    }
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static const uint8_t kIndexMask = 0x3;
+    static const uint8_t kFresh = 0x4;
+
+    T slots[3];
+    uint8_t backIndex = 0;              // owned by the writer
+    uint8_t frontIndex = 2;             // owned by the reader
+    std::atomic<uint8_t> middle{1};     // slot index plus the fresh bit
+};